@@ -0,0 +1,33 @@
+#ifndef ARENA_H
+#define ARENA_H
+#include <stddef.h>
+
+// First block size; later blocks double as needed
+#define ARENA_BLOCK_SIZE 4096
+
+typedef struct ArenaBlock {
+    struct ArenaBlock *prev;
+    size_t size;            // Bytes in data
+    size_t used;
+    max_align_t data[];     // Aligned for any type
+} ArenaBlock;
+
+// Bump allocator for everything one command needs while it is parsed and
+// started (tokens, plan, argv, glob matches): allocation is a pointer bump and
+// the whole lot goes at once with arena_reset(). A zeroed Arena is ready to use.
+typedef struct {
+    ArenaBlock *head;       // Block being filled; NULL until the first allocation
+    size_t total;           // Sum of block sizes, kept as one block by arena_reset()
+} Arena;
+
+// Returns n bytes aligned for any type. Like xstrdup(), gives up on OOM.
+void *arena_alloc(Arena *a, size_t n);
+char *arena_strndup(Arena *a, const char *s, size_t n);
+char *arena_strdup(Arena *a, const char *s);
+
+// Frees everything allocated so far but keeps the memory for the next command
+// (merged into one block, so a steady workload stops calling malloc).
+void arena_reset(Arena *a);
+void arena_destroy(Arena *a);
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+#include <stddef.h>
+#include <sys/types.h>
+
+// Output up to this size stays in a heap buffer; beyond it, the capture spills
+// into a memfd (tmpfs-backed) so the heap footprint of a job stays bounded.
+#define CAPTURE_MEM_MAX (64 * 1024)
+// Default per-job cap on captured bytes (0 means unlimited)
+#define CAPTURE_DEFAULT_LIMIT (64UL * 1024 * 1024)
+#define CAPTURE_TRUNC_MARKER "\n[output truncated: limit of %zu bytes reached]\n"
+
+typedef struct {
+    char *mem;          // In-memory bytes (NULL once spilled)
+    size_t cap;         // Allocated size of mem
+    size_t len;         // Bytes captured so far (memory or spill file)
+    int spill_fd;       // memfd holding the output once it outgrew CAPTURE_MEM_MAX, else -1
+    size_t limit;       // Max bytes kept; 0 = unlimited
+    int truncated;      // Set once output past the limit was dropped
+    int marked;         // Truncation marker already appended
+} Capture;
+
+void capture_init(Capture *c, size_t limit);
+void capture_free(Capture *c);
+
+// Moves whatever is currently readable on fd into the capture.
+// Returns bytes consumed, 0 on EOF or once the limit is hit (c->truncated is set),
+// -1 on error (errno set; EAGAIN/EINTR are not fatal).
+ssize_t capture_fill(Capture *c, int fd);
+
+// Appends bytes produced by the caller itself (respects the limit).
+int capture_append(Capture *c, const char *data, size_t n);
+
+// Appends the truncation marker if output was dropped, once, after the last run
+// filling the capture has drained (the whole command list, not each pipeline).
+// The marker may take len past the limit; appends after it are dropped.
+void capture_finish(Capture *c);
+
+// Returns a NUL-terminated copy of the whole capture (reads back the spill file).
+char *capture_to_string(const Capture *c);
+
+// Writes the whole capture to fd. Returns 0, or -1 if a write failed.
+int capture_write(const Capture *c, int fd);
+
+// Copies bytes [off, off+n) into buf; works for both in-memory and spilled output.
+ssize_t capture_pread(const Capture *c, char *buf, size_t n, off_t off);
+
+#endif
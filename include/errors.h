@@ -12,4 +12,8 @@
 #define ERR_CMD_MISSING_BEFORE_PIPE "Command missing before pipe.\n"
 #define ERR_EMPTY_CMD_BETWEEN_PIPES "Empty command between pipes.\n"
 #define ERR_UNCLOSED_QUOTES "Unclosed quotes.\n"
+#define ERR_CMD_MISSING_BEFORE_BG "Command missing before &.\n"
+#define ERR_NO_SUCH_JOB "No such job.\n"
+#define ERR_LIST_SYNTAX "Syntax error in command list.\n"
+#define ERR_UNMATCHED_PAREN "Unmatched parenthesis.\n"
 #endif
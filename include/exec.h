@@ -1,11 +1,108 @@
 #ifndef EXEC_H
 #define EXEC_H
+#include "capture.h"
+#include "plancache.h"
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <time.h>
 
-// Executes a single command, captures its output/error, and returns it as a string.
-char* execute_command(char *args[], char *inputFile, char *outputFile, char *errorFile, int outputAppend);
+// Output modes for execute_command()/execute_pipeline()
+#define EXEC_CAPTURE 0   // stdout/stderr are collected into ExecResult.out/.err
+#define EXEC_DIRECT 1    // the command inherits the caller's stdin/stdout/stderr
 
-// Executes a pipeline, captures the final output/error, and returns it as a string.
-// client_fd is used for stderr redirection in children and should be the client socket.
-char* execute_pipeline(char *cmd, int client_fd);
+typedef struct {
+    pid_t pid;
+    int status;             // Exit status in shell convention (128+N if killed by signal N), -1 if never ran
+    struct timespec started;  // CLOCK_MONOTONIC time of fork()
+    double wall_ms;         // fork() to reap
+    struct rusage ru;       // From wait4(): CPU time, max RSS, context switches
+} StageResult;
+
+typedef struct {
+    int validate_err;       // VALIDATE_SUCCESS or VALIDATE_ERR_* (pipeline syntax)
+    int parse_err;          // PARSE_SUCCESS or PARSE_ERR_* (stage syntax)
+    int nstages;            // Number of entries in stages
+    StageResult *stages;    // Per-stage pid and exit status
+    int exit_status;        // Status of the last stage; 2 on syntax errors; -1 if nothing ran
+    Capture out;            // stdout of the last stage (EXEC_CAPTURE only)
+    Capture err;            // stderr of every stage, plus syntax error messages
+} ExecResult;
+
+// Optional per-job process attributes for exec_job_start()
+typedef struct {
+    void (*child_setup)(void *arg);  // Runs in every stage's child after fork(), before redirections and exec
+    void *arg;
+    int stdin_fd;           // First stage's stdin when >= 0 (instead of /dev/null); still owned by the caller
+    int pgrp;               // Job control: all stages join a new process group led by the first stage
+    int foreground;         // With pgrp: that group takes over the terminal on stdin (tcsetpgrp)
+    char *const *envp;      // Environment for the commands, or NULL to inherit ours
+    // Maps a command name without '/' to an executable path (e.g. from a cache), in
+    // the parent before fork(); NULL leaves the PATH search to execvp() in the child
+    const char *(*resolve)(void *ctx, const char *name);
+    void *resolve_ctx;
+    PlanCache *plans;       // Reuse parsed plans across calls with the same text, or NULL
+} ExecAttr;
+
+// A capture-mode pipeline whose completion is driven by the caller, so one thread
+// can supervise many of them. Register out_fd, err_fd and every pidfds[i] >= 0
+// for readability and dispatch to exec_job_on_output()/exec_job_on_exit();
+// once pending reaches 0, call exec_job_finish().
+typedef struct {
+    ExecResult *res;
+    int out_fd;             // stdout capture pipe (read end); -1 once drained
+    int err_fd;             // stderr capture pipe (read end); -1 once drained
+    int *pidfds;            // Per-stage pidfd; negative once reaped or when unavailable
+    int pending;            // Capture pipes and pidfds still open
+    int epfd;               // epoll set the fds are registered with (removed before close), or -1
+    int base;               // First of this run's stages in res->stages; pidfds[i] is stage base + i
+} ExecJob;
+
+// Prepares res; limit caps each of out/err (0 = unlimited).
+void exec_result_init(ExecResult *res, size_t limit);
+void exec_result_free(ExecResult *res);
+
+// Returns the errors.h message for a syntax error recorded in res, or NULL.
+const char *exec_error_message(const ExecResult *res);
+
+// Marks the syntax error recorded in res as the result: status 2, message in res->err
+void exec_record_syntax_error(ExecResult *res);
+
+// Formats one stage's accounting as "pid=.. exit=.. wall_ms=.. user_ms=.. sys_ms=..
+// maxrss_kb=.. vcsw=.. ivcsw=..". Returns the snprintf() length.
+int exec_format_stage_stats(const StageResult *st, char *buf, size_t size);
+
+// Records a wait()ed status for st: exit code in shell convention, wall time, rusage
+void exec_record_exit(StageResult *st, int status, const struct rusage *ru);
+
+// Executes a single, already parsed command. Returns res->exit_status.
+int execute_command(char *args[], char *inputFile, char *outputFile, char *errorFile, int outputAppend, int mode, ExecResult *res);
+
+// Parses (parse_plan()) and executes a pipeline or single command. In EXEC_CAPTURE
+// mode the first stage of a pipeline reads /dev/null and output is streamed into
+// res while the stages run; in EXEC_DIRECT mode data flows at native pipe
+// throughput to the caller's terminal.
+// Syntax errors are reported through res (and their message appended to res->err).
+// Returns res->exit_status.
+int execute_pipeline(char *cmd, int mode, ExecResult *res);
+
+// Parses cmd and starts it in EXEC_DIRECT mode without waiting, for callers that
+// reap the stages themselves (job control waits on the process group from
+// attr->pgrp). Returns 0 if stages are running, -1 on a syntax error (recorded
+// in res and res->err) or spawn failure.
+int exec_spawn(char *cmd, ExecResult *res, const ExecAttr *attr);
+
+// Parses cmd (or takes its plan from attr->plans) and starts it in EXEC_CAPTURE
+// mode without waiting; attr may be NULL.
+// Returns 0 if stages are running, -1 on a syntax error or spawn failure (res says
+// which). Either way, call exec_job_finish() once job->pending is 0.
+// A res that already holds a finished run (earlier pipelines of a command list)
+// is extended: the new stages and output are appended to it.
+int exec_job_start(const char *cmd, ExecResult *res, ExecJob *job, const ExecAttr *attr);
+void exec_job_on_output(ExecJob *job, int fd);
+void exec_job_on_exit(ExecJob *job, int stage);
+// Reaps stages that had no pidfd and sets res->exit_status. The captures stay
+// open for later pipelines of a command list; capture_finish() them once the
+// whole list has run.
+void exec_job_finish(ExecJob *job);
 
 #endif
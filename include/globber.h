@@ -0,0 +1,18 @@
+#ifndef GLOBBER_H
+#define GLOBBER_H
+#include "arena.h"
+
+#define GLOB_CACHE_BUCKETS 1024
+#define GLOB_CACHE_MAX_DIRS 4096
+#define GLOB_CACHE_MAX_NAMES (1 << 20)   // Summed over all cached listings
+#define GLOB_WALK_THREADS 8               // Upper bound on threads per ** walk
+
+// Expands pattern the way glob(3) does (sorted matches; a leading dot must be
+// matched explicitly; \ escapes), plus ** as a whole path component: any number
+// of subdirectory levels (symlinks are not followed), or every entry below when
+// it ends the pattern. Directory listings come from a process-wide cache that is
+// checked against each directory's mtime; ** walks list directories on several
+// threads. Returns the number of matches, stored (sorted, in a) in *out.
+int glob_expand(Arena *a, const char *pattern, char ***out);
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef ISOLATE_H
+#define ISOLATE_H
+// cpu_set_t needs _GNU_SOURCE, defined by every file that includes this header
+#include <sched.h>
+#include <limits.h>
+
+// Resource limits and CPU placement for spawned jobs. Each job gets its own
+// cgroup v2 leaf under a delegated root; when no usable root is available the
+// limits fall back to setrlimit() and a lower scheduling priority; the task limit
+// (pids_max) has no per-job rlimit and is only enforced through cgroups.
+typedef struct {
+    const char *cgroup_root;    // Delegated cgroup v2 directory for job leaves, or NULL
+    const char *cpu_max;        // cpu.max for each job, e.g. "50000 100000", or NULL
+    long long memory_max;       // memory.max in bytes; 0 = unlimited
+    long pids_max;              // pids.max; 0 = unlimited
+    cpu_set_t shell_cpus;       // CPUs shell jobs may run on (if pin_shell)
+    int pin_shell;
+    cpu_set_t server_cpus;      // CPUs for the server's own threads, incl. program jobs (if pin_server)
+    int pin_server;
+    int use_cgroups;            // Set by isolate_init() once the root is usable
+} IsolateConfig;
+
+// Per-job state; the leaf lives from isolate_job_begin() to isolate_job_end()
+typedef struct {
+    const IsolateConfig *cfg;
+    char leaf[PATH_MAX];        // Job's cgroup directory ("" when not using cgroups)
+    int procs_fd;               // Open leaf/cgroup.procs; children write "0" to join, or -1
+    int need_fallback;          // Some limit could not be set on the leaf: apply rlimits too
+} JobIsolation;
+
+// Parses a Linux-style CPU list ("0-3,6") into set. Returns 0, or -1 if malformed.
+int isolate_parse_cpulist(const char *list, cpu_set_t *set);
+
+// Prepares the cgroup root (moves the server into a "server" leaf and enables the
+// cpu/memory/pids controllers for job leaves) and pins the calling thread to
+// server_cpus. Falls back to rlimits when the root is not delegated.
+int isolate_init(IsolateConfig *cfg);
+
+// Returns 1 if cfg asks for any limit or pinning at all
+int isolate_enabled(const IsolateConfig *cfg);
+
+// Creates the job's cgroup leaf and writes its limits. Never fails hard: on error
+// the job runs under the rlimit fallback.
+void isolate_job_begin(const IsolateConfig *cfg, int job_id, JobIsolation *ji);
+
+// ExecAttr child_setup hook (arg is a JobIsolation*): joins the leaf or applies
+// the fallback limits, then pins to shell_cpus. Runs between fork() and exec().
+void isolate_child(void *arg);
+
+// Removes the job's leaf once every process in it has been reaped
+void isolate_job_end(JobIsolation *ji);
+
+#endif
@@ -1,5 +1,10 @@
 #ifndef JOB_H
 #define JOB_H
+#include <stddef.h>
+#include "exec.h"
+#include "parse.h"
+#include "isolate.h"
+#include "session.h"
 
 typedef enum {
     JOB_CMD,    // Shell command (-1 burst)
@@ -15,9 +20,21 @@ typedef struct Job {
     int initial_burst;      // N (or -1)
     int remaining_time;     // Decrements as it runs
     int rounds_run;         // To track Quantum (3s vs 7s)
-    int bytes_sent;         // Track total bytes sent to client for this job
+    size_t bytes_sent;      // Track total bytes sent to client for this job
     int arrival_seq;        // Incremented for each new job (tracks arrival order)
     int run_epoch_seq;      // Marks the arrival counter when this job started its current run
+    ExecResult result;      // Shell jobs: statuses and captured output
+    ExecJob exec;           // Shell jobs: running pipeline watched by the supervisor
+    CmdList list;           // Shell jobs: the command list; its pipelines run one by one
+    Arena list_arena;       // Shell jobs: backs list, freed when the job finishes
+    int list_pos;           // Next step of list (see list_next)
+    JobIsolation iso;       // Shell jobs: cgroup leaf / fallback limits
+    int stdin_fd;           // Read end of the client's stdin upload pipe, or -1 (/dev/null)
+    char *cache_key;        // Result cache key if the command is cacheable, else NULL
+    size_t cache_key_len;
+    struct Job *followers;  // Identical commands sharing this job's run (single-flight), linked by next
+    struct Job *inflight_next;  // Registry of running cacheable jobs
+    Session *session;       // Shell jobs of a session client (-S): cwd/env to run in, else NULL
     struct Job *next;       // For Linked List
 } Job;
 
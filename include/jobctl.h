@@ -0,0 +1,48 @@
+#ifndef JOBCTL_H
+#define JOBCTL_H
+#include "exec.h"
+
+#define JC_MAX_JOBS 64
+
+typedef enum {
+    JC_RUNNING,
+    JC_STOPPED,
+    JC_DONE
+} JcState;
+
+// One pipeline, as listed by `jobs`; normally in its own process group
+typedef struct {
+    int id;                 // %N; 0 marks a free slot
+    pid_t pgid;             // Process group (pid of the first stage, or the shell's own)
+    int shared_pgrp;        // Foreground job of a non-interactive shell: stays in our group
+    char *cmd;              // Command text for notifications
+    ExecResult res;         // Stage pids and statuses
+    int alive;              // Stages not yet reaped
+    JcState state;
+} ShellJob;
+
+// Sets up job control. When interactive (stdin is a terminal and commands come
+// from it) the shell takes its own process group and the terminal, ignores the
+// signals meant for foreground jobs, and announces job state changes. Otherwise
+// (scripts, -c, piped stdin) foreground jobs stay in the shell's process group,
+// so they can read the terminal and Ctrl-C reaches them; only background jobs
+// get groups of their own.
+void jc_init(int interactive);
+
+// Runs cmd as a new job: in the foreground (waits; Ctrl-Z stops it into the job
+// table) or, with background set, returns at once after printing "[N] pgid".
+// Returns the foreground exit status (0 for background jobs, 2 on syntax errors).
+int jc_run(char *cmd, int background);
+
+// Runs the jobs/fg/bg/wait builtins. Returns 1 (and the status in *status) if
+// cmd was one of them, 0 otherwise.
+int jc_builtin(const char *cmd, int *status);
+
+// Reaps whatever SIGCHLD announced and prints "Done"/"Stopped" notices for
+// background jobs. Call before each prompt.
+void jc_notify(void);
+
+// On shell exit: stopped jobs would never run again, so hang them up
+void jc_shutdown(void);
+
+#endif
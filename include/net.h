@@ -9,11 +9,38 @@
 #include <string.h>
 #include <errno.h>
 #include <stdint.h>
+#include <sys/types.h>
 #define MAX_BUFFER_SIZE 1024
+
+// Frame header: one 4-byte network-order word; the top byte is the frame type,
+// the low 24 bits the payload length. Plain send_line() frames have type 0.
+#define FRAME_LINE 0            // Text line; the client prints it followed by a newline
+#define FRAME_DATA 1            // Raw command stdout; the client writes it as-is
+#define FRAME_STDERR 2          // Raw command stderr (and syntax error messages)
+#define FRAME_STATUS 3          // Job result: "exit=<n> stages=<s1>,<s2>... parse=<code> validate=<code>"
+#define FRAME_STATS 4           // Per-stage accounting: "stage=<i> pid=.. exit=.. wall_ms=.. user_ms=.. ..."
+// Client -> server
+#define FRAME_CMD_STDIN 5       // Command whose first stage reads the FRAME_STDIN frames that follow
+#define FRAME_STDIN 6           // Chunk of that command's stdin; an empty FRAME_STDIN is EOF
+#define FRAME_TYPE_SHIFT 24
+#define FRAME_LEN_MASK 0x00FFFFFF
+// Largest FRAME_DATA/FRAME_STDERR payload the server emits (fits the client's receive buffer)
+#define FRAME_DATA_CHUNK (32 * 1024)
+
 int create_server_socket(int port);
 int accept_client_connection(int server_fd, struct sockaddr_in *client_addr);
 int create_client_socket(const char *server_ip, int port);
 int send_line(int socket_fd, const char *line);
 int receive_line(int socket_fd, char *buffer, int buffer_size);
+int send_frame(int socket_fd, int type, const char *data, size_t len);
+// Sends len bytes of file_fd starting at offset as one frame, using sendfile().
+int send_frame_file(int socket_fd, int type, int file_fd, off_t offset, size_t len);
+int receive_frame(int socket_fd, int *type, char *buffer, int buffer_size);
+// Like receive_frame(), but grows *buffer (malloc'd, *size bytes; may start NULL)
+// to fit any payload instead of rejecting long ones.
+int receive_frame_alloc(int socket_fd, int *type, char **buffer, size_t *size);
+// Reads only a frame header; returns the payload length (left on the socket for
+// the caller to consume), or -1 on error/disconnect.
+int receive_frame_header(int socket_fd, int *type);
 void close_socket(int socket_fd);
 #endif
@@ -0,0 +1,18 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+// GNU parallel-style builtin:
+//   parallel [-j N] command template ::: arg...     (arguments are globbed)
+//   parallel [-j N] command template :::: file      (one argument per line; - = stdin)
+//   parallel [-j N] command template                (one argument per line from stdin)
+// A template given as one quoted word is a full mysh command line (pipes and
+// redirections work); otherwise its words are kept as written. {} is replaced by
+// the argument, {.} by the argument without its extension and {/} by its
+// basename; without any of them the argument is appended. Up to N commands
+// (default: online CPUs) run at once; output is printed in input order.
+
+// Runs cmd if it is a parallel invocation. Returns 1 (status in *status: the
+// number of failed jobs, at most 101) or 0 if cmd is something else.
+int parallel_builtin(const char *cmd, int *status);
+
+#endif
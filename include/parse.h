@@ -1,18 +1,91 @@
 #ifndef PARSE_H
 #define PARSE_H
+#include "arena.h"
 #define PARSE_SUCCESS 0
 #define PARSE_ERR_SYNTAX 1
-#define PARSE_ERR_TOO_MANY_ARGS 2
 #define PARSE_ERR_NO_INPUT_FILE 3
 #define PARSE_ERR_NO_OUTPUT_FILE 4
 #define PARSE_ERR_NO_OUTPUT_FILE_AFTER 8
 #define PARSE_ERR_NO_ERROR_FILE 5
 #define PARSE_ERR_EMPTY_CMD_REDIR 6
 #define PARSE_ERR_UNCLOSED_QUOTES 7
+#define PARSE_ERR_LIST_SYNTAX 9
+#define PARSE_ERR_UNMATCHED_PAREN 10
+#define PARSE_ERR_MISSING_BEFORE_BG 11
 #define VALIDATE_SUCCESS 0
 #define VALIDATE_ERR_STARTS_PIPE 1
 #define VALIDATE_ERR_EMPTY_CMD 2
 #define VALIDATE_ERR_ENDS_PIPE 3
-int parse_command(char *cmd, char *args[], char **inputFile, char **outputFile, char **errorFile, int isPipeline, int *outputAppend);
-int validate_pipeline(char *cmd);
+
+struct PlanGroup;
+
+// One stage of a parsed pipeline
+typedef struct {
+    char **args;            // NULL-terminated argv, globbed
+    char *inputFile;        // < target, or NULL
+    char *outputFile;       // > or >> target, or NULL
+    char *errorFile;        // 2> target, or NULL
+    int outputAppend;       // 1 for append (>>), 0 for truncate (>)
+    // args[batch_start..batch_end) came from glob patterns: beyond ARG_MAX that span
+    // is split over several runs, each keeping the arguments around it (like xargs)
+    int batch_start, batch_end;
+    struct PlanGroup *group;  // ( list ) run in a subshell instead of args, or NULL
+} PlanStage;
+
+// Execution plan of a pipeline, built in one quote-aware pass over its tokens
+typedef struct {
+    PlanStage *stages;
+    int nstages;
+    int validate_err;       // VALIDATE_SUCCESS or VALIDATE_ERR_* (pipe structure)
+    int parse_err;          // PARSE_SUCCESS or PARSE_ERR_* (stage syntax)
+    int globbed;            // Some argv came from glob patterns, so it depends on the directory
+    int grouped;            // Some stage is a ( list ) (not deep-copied by the plan cache)
+} Plan;
+
+// is_pipeline for parse_plan(): decide by whether the line has a |
+#define PLAN_AUTO -1
+
+// Splits cmd at unquoted | into stages with argv and redirections; a stage may
+// instead be a ( list ), whose pipelines are all parsed here too. is_pipeline
+// (1, 0 or PLAN_AUTO) picks the missing-output-file message. Returns 0, or -1
+// with the first error in validate_err/parse_err (matching errors.h) and no stages.
+// Tokens, stages, argv and glob matches all live in a: reset it once the plan
+// has been run (or forked; children keep their own copy).
+int parse_plan(Arena *a, const char *cmd, int is_pipeline, Plan *plan);
+
+// A command list (a & b; c && d || (e; f)) flattened into steps. Each step joins
+// the previous command with ;, && or || (& joins like ;); a skipped step jumps to
+// .skip, which for a group is just past its closing parenthesis.
+typedef enum { LIST_PIPELINE, LIST_GROUP_OPEN, LIST_GROUP_CLOSE } ListStepKind;
+typedef enum { LIST_SEQ, LIST_AND, LIST_OR } ListOp;
+typedef struct {
+    ListStepKind kind;
+    ListOp op;
+    char *text;             // LIST_PIPELINE: the pipeline's source text, quotes intact
+    int skip;
+    int background;         // LIST_PIPELINE ended by &: started without waiting for it
+} ListStep;
+typedef struct {
+    ListStep *steps;
+    int nsteps;
+} CmdList;
+
+// A ( list ) that is piped or redirected as a whole. It runs in a forked
+// subshell, so the plans of its pipelines are built before the fork.
+typedef struct PlanGroup {
+    CmdList list;
+    Plan *plans;            // By step index (LIST_PIPELINE steps only)
+} PlanGroup;
+
+// Splits cmd at unquoted ;, &, && and || and groups ( ). A group that is piped,
+// redirected or sent to the background, as in (a; b) | c, (a; b) > out or
+// (a; b) &, stays inside its pipeline's text for parse_plan() to run as one stage. Returns PARSE_SUCCESS or
+// PARSE_ERR_UNCLOSED_QUOTES/LIST_SYNTAX/UNMATCHED_PAREN/MISSING_BEFORE_BG (list
+// is then empty).
+// The list lives in a until the arena is reset.
+int parse_list(Arena *a, const char *cmd, CmdList *list);
+// Returns the next pipeline to run after one that exited with status (ignored
+// for the first), advancing *pos from 0; NULL once the list is done. Its step is
+// list->steps[*pos - 1] (e.g. for .background).
+const char *list_next(const CmdList *list, int *pos, int status);
 #endif
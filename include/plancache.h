@@ -0,0 +1,40 @@
+#ifndef PLANCACHE_H
+#define PLANCACHE_H
+#include "parse.h"
+#include "arena.h"
+#include <pthread.h>
+
+#define PLAN_CACHE_BUCKETS 256
+#define PLAN_CACHE_DEFAULT_ENTRIES 512
+
+typedef struct PlanEntry {
+    char *text;                     // Exact command text: the key
+    Plan plan;                      // Never changes once stored
+    Arena arena;                    // Backs text and plan
+    int refs;                       // The cache's own plus one per caller between lookup and release
+    struct PlanEntry *next;         // Bucket chain
+    struct PlanEntry *newer, *older;  // LRU order
+} PlanEntry;
+
+// LRU map from a pipeline's text to its parsed plan, shared by every thread that
+// launches jobs. Only plans whose argv does not depend on the filesystem (no glob
+// patterns) and that parsed cleanly are kept, so a hit can be forked right away.
+typedef struct {
+    PlanEntry *buckets[PLAN_CACHE_BUCKETS];
+    PlanEntry *newest, *oldest;
+    int nentries, max_entries;      // max_entries 0 disables the cache
+    pthread_mutex_t lock;
+} PlanCache;
+
+void plan_cache_init(PlanCache *pc, int max_entries);
+void plan_cache_destroy(PlanCache *pc);
+
+// Returns the entry for cmd, held for the caller, or NULL on a miss
+PlanEntry *plan_cache_lookup(PlanCache *pc, const char *cmd);
+void plan_cache_release(PlanCache *pc, PlanEntry *e);
+
+// Keeps a copy of plan (parsed from cmd) unless it is not cacheable, evicting
+// the least recently used entry when full
+void plan_cache_insert(PlanCache *pc, const char *cmd, const Plan *plan);
+
+#endif
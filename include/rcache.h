@@ -0,0 +1,54 @@
+#ifndef RCACHE_H
+#define RCACHE_H
+#include "exec.h"
+#include <stddef.h>
+#include <pthread.h>
+
+#define RCACHE_BUCKETS 256
+#define RCACHE_MAX_ENTRIES 1024
+#define RCACHE_ENTRY_MAX (1024 * 1024)  // Larger results (stdout + stderr) are not cached
+#define RCACHE_DEFAULT_TTL_MS 2000
+
+typedef struct RCacheEntry {
+    char *key;
+    size_t key_len;
+    char *out, *err;                // Captured stdout/stderr
+    size_t out_len, err_len;
+    int exit_status;
+    long long expires_ms;           // CLOCK_MONOTONIC deadline
+    struct RCacheEntry *next;       // Bucket chain
+} RCacheEntry;
+
+// Output cache for commands the operator declared pure (no side effects, output
+// depends only on argv and the files it names). Keys are the normalized argv from
+// parse_plan() plus device/inode/size/mtime of every argument and input
+// redirection that names an existing file, so edits invalidate entries at once;
+// the TTL bounds staleness for everything else (/proc files, directory contents).
+typedef struct {
+    char **pure;                    // Command names (argv[0] basename) that may be cached
+    int npure;
+    long ttl_ms;
+    int nentries;
+    RCacheEntry *buckets[RCACHE_BUCKETS];
+    pthread_mutex_t lock;
+} ResultCache;
+
+// pure_list is comma-separated ("cat,ls,wc"); NULL leaves the cache disabled.
+int rcache_init(ResultCache *rc, const char *pure_list, long ttl_ms);
+void rcache_destroy(ResultCache *rc);
+int rcache_enabled(const ResultCache *rc);
+
+// Builds the cache key for cmd. Returns a malloc'd key (length in *len), or NULL
+// if cmd is not cacheable: a pipeline, an output redirection, a syntax error or a
+// command not declared pure.
+char *rcache_key(const ResultCache *rc, const char *cmd, size_t *len);
+
+// On a hit, copies the cached output into res->out/res->err, sets res->exit_status
+// and returns 1; returns 0 on a miss.
+int rcache_lookup(ResultCache *rc, const char *key, size_t len, ExecResult *res);
+
+// Remembers a finished job's result; only clean runs (exit 0, nothing truncated,
+// within RCACHE_ENTRY_MAX) are kept.
+void rcache_store(ResultCache *rc, const char *key, size_t len, const ExecResult *res);
+
+#endif
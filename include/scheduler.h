@@ -0,0 +1,74 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+#include "job.h"
+#include <stdio.h>
+#include <pthread.h>
+
+#define SCHED_QUANTUM_1 3       // Ticks in a demo job's first quantum
+#define SCHED_QUANTUM_REST 7    // Ticks in every later quantum
+
+// One P<client>-(t) step of the timeline summary
+typedef struct TimelineEntry {
+    int client_id;
+    int elapsed_time;           // global_time when the quantum ended
+    struct TimelineEntry *next;
+} TimelineEntry;
+
+// Scheduling state shared by the server and the simulator (schedsim): shell
+// commands have absolute priority (FIFO); demo/program jobs share the CPU by
+// RR+SRJF, quanta of SCHED_QUANTUM_1 then SCHED_QUANTUM_REST ticks, preempted by
+// shell commands and by newer jobs with strictly shorter remaining time.
+typedef struct {
+    Job *shell_head;            // FIFO queue for shell commands (run immediately)
+    Job *job_head;              // RR+SRJF queue for demo/program jobs only
+    Job *running;               // Demo job between sched_next() and sched_after_run()
+    int last_job_id;            // Not picked twice in a row while another job is as short
+    int arrival_counter;        // arrival_seq of the newest job
+    int preemptions;            // Quanta cut short so far
+    // Timeline summary, printed whenever both queues run empty; scheduler thread only
+    int global_time;            // Ticks of demo work since the queues were last empty
+    TimelineEntry *timeline_head, *timeline_tail;
+    void (*log)(const char *fmt, ...);  // Event log ("(1) --- started (5)"), or NULL
+    pthread_mutex_t lock;       // Guards the queues and counters
+    pthread_cond_t cond;        // Signaled on every enqueue
+} Scheduler;
+
+void sched_init(Scheduler *s, void (*log)(const char *fmt, ...));
+
+// The queue operations below expect the caller to hold s->lock.
+
+// Enqueue shell command to immediate-execution queue (absolute priority, FIFO)
+void sched_add_shell(Scheduler *s, Job *job);
+// Enqueue demo/program job to RR+SRJF scheduling queue
+void sched_add(Scheduler *s, Job *job);
+
+// SRJF Selection Algorithm with "no same job twice consecutively" rule
+// If exclude is non-NULL, excludes that job from selection (for preemption checks)
+// If last_job_id >= 0, avoids selecting that job ID unless it's the only option
+// With remove, unlinks the job it returns from the queue
+Job *select_job(Scheduler *s, int remove, Job *exclude, int last_job_id);
+
+// Takes the next job to run: the oldest shell command, else select_job(). Starts
+// its run epoch (jobs arriving from now on are "newer"). NULL if both queues are empty.
+Job *sched_next(Scheduler *s);
+
+// Whether running job must yield: a shell command is waiting, or a demo job that
+// arrived during this run has strictly less time remaining
+int sched_should_preempt(const Scheduler *s, const Job *job);
+
+// On the scheduler thread (these take s->lock themselves):
+
+// Runs one quantum of demo job, calling tick() for each tick of work (the server
+// sleeps a second, the simulator advances its clock) and checking for preemption
+// before the first tick and after every one. Returns the ticks run.
+int sched_run_quantum(Scheduler *s, Job *job, void (*tick)(void *ctx, Job *job), void *ctx);
+
+// Records ticks of work by job on the timeline and puts it back at the front of
+// the queue if it has time left. Returns 1 if requeued, 0 if the job is done.
+int sched_after_run(Scheduler *s, Job *job, int ticks);
+
+// Prints "0)-P1-(3)-P2-(5)..." for the work since the queues were last empty and
+// starts a new timeline. Does nothing if there was none.
+void sched_print_timeline(Scheduler *s, FILE *out);
+
+#endif
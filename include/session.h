@@ -0,0 +1,41 @@
+#ifndef SESSION_H
+#define SESSION_H
+#include "exec.h"
+#include <limits.h>
+#include <pthread.h>
+
+#define SESSION_PATH_CACHE 64
+
+typedef struct {
+    char *name;             // Command name as typed
+    char *path;             // Executable found for it on the session's PATH
+} SessionPath;
+
+// Long-lived execution context of one client connection: working directory,
+// environment and resolved command paths carry over between its commands.
+// Shared by the connection and its queued/running jobs, hence refcounted.
+typedef struct {
+    pthread_mutex_t lock;   // Held while a job is spawned from this session
+    int refs;
+    char cwd[PATH_MAX];
+    char **env;             // NULL-terminated "NAME=value" list, usable as envp
+    int nenv, env_cap;
+    SessionPath paths[SESSION_PATH_CACHE];
+    int npaths;
+    int next_evict;         // Round-robin replacement slot once the cache is full
+} Session;
+
+// Starts in the server's cwd with a copy of its environment (refs = 1)
+Session *session_new(void);
+void session_hold(Session *s);
+void session_release(Session *s);
+
+// Runs the session builtins cd, export and unset. Returns 1 if cmd was one of
+// them (output and exit status in res), 0 otherwise.
+int session_builtin(Session *s, const char *cmd, ExecResult *res);
+
+// ExecAttr.resolve hook (ctx is the Session): looks name up on the session's
+// PATH once and remembers the result. Call with s->lock held.
+const char *session_resolve(void *ctx, const char *name);
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef SUPERVISOR_H
+#define SUPERVISOR_H
+#include "exec.h"
+#include <pthread.h>
+
+// Callback for a finished job; runs after exec_job_finish() so job->res is complete.
+typedef void (*sv_done_fn)(ExecJob *job, void *arg);
+
+// Watches the capture pipes and pidfds of many running ExecJobs with one epoll
+// set, so a single thread can supervise any number of commands and never blocks
+// on one slow child.
+typedef struct {
+    int epfd;
+    int wake_fd;            // eventfd that interrupts sv_run_once() (e.g. on shutdown)
+    int active;             // Jobs registered and not yet finished
+    pthread_mutex_t lock;   // Serializes registration against event dispatch
+} Supervisor;
+
+int sv_init(Supervisor *sv);
+void sv_destroy(Supervisor *sv);
+
+// Registers a job started with exec_job_start(). If nothing is outstanding, the
+// job is finished and done() is called right away on the calling thread.
+int sv_add(Supervisor *sv, ExecJob *job, sv_done_fn done, void *arg);
+
+// Waits up to timeout_ms (-1 = forever) for events and dispatches them.
+// Returns the number of jobs that completed, or -1 on error.
+int sv_run_once(Supervisor *sv, int timeout_ms);
+
+// Makes a blocked sv_run_once() return. Async-signal-safe.
+void sv_wake(Supervisor *sv);
+
+#endif
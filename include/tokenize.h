@@ -1,8 +1,17 @@
 #ifndef TOKENIZE_H
 #define TOKENIZE_H
+#include "arena.h"
 #include <stdbool.h>
-typedef struct { char *val; bool was_quoted; } QTok;
-int qtokenize(const char *line, QTok **out, int *count);
-void free_qtokens(QTok *arr, int n);
-void apply_globbing(char **argv, bool *was_quoted, int *argc);
+typedef struct {
+    char *val;
+    bool was_quoted;
+    int start, end;   // Source span in the line, [start, end), quotes included
+} QTok;
+// Splits line into words and unquoted operators: | < > >> 2> ; & && || ( )
+// The array and every value live in a, so there is nothing to free.
+int qtokenize(Arena *a, const char *line, QTok **out, int *count);
+// Expands unquoted words with glob characters. Returns the NULL-terminated argv
+// (in a, like the matches) and its length in *argc; [*exp_start, *exp_end) spans
+// the first through the last expanded match (empty if nothing matched).
+char **apply_globbing(Arena *a, char **words, const bool *was_quoted, int *argc, int *exp_start, int *exp_end);
 #endif
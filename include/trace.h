@@ -0,0 +1,31 @@
+#ifndef TRACE_H
+#define TRACE_H
+#include <stdio.h>
+#include <pthread.h>
+
+// Arrival trace of the jobs the server scheduled, one JSON object per line:
+//   {"t_ms": 1520.4, "client_id": 2, "command": "demo 5", "burst": 5}
+// t_ms counts from when the trace was opened; burst is -1 for shell commands.
+typedef struct {
+    FILE *f;
+    double start_ms;            // CLOCK_MONOTONIC time of trace_open()
+    pthread_mutex_t lock;       // Client threads record concurrently
+} Trace;
+
+typedef struct {
+    double t_ms;
+    int client_id;
+    char *command;              // malloc'd
+    int burst;
+} TraceEvent;
+
+int trace_open(Trace *t, const char *path);
+void trace_close(Trace *t);
+void trace_record(Trace *t, int client_id, const char *command, int burst);
+
+// Reads a trace file into *out (sorted by t_ms; free with trace_free()).
+// Returns the number of events, or -1 with a message on a malformed line.
+int trace_load(const char *path, TraceEvent **out);
+void trace_free(TraceEvent *events, int n);
+
+#endif
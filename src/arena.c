@@ -0,0 +1,68 @@
+#include "arena.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define ARENA_ALIGN 16
+
+static ArenaBlock *new_block(size_t size) {
+    ArenaBlock *b = malloc(sizeof(ArenaBlock) + size);
+    if (!b) {
+        perror("malloc");
+        _exit(127);
+    }
+    b->prev = NULL;
+    b->size = size;
+    b->used = 0;
+    return b;
+}
+
+void *arena_alloc(Arena *a, size_t n) {
+    n = (n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    ArenaBlock *b = a->head;
+    if (!b || b->size - b->used < n) {
+        size_t size = b ? b->size * 2 : ARENA_BLOCK_SIZE;
+        while (size < n) size *= 2;
+        ArenaBlock *nb = new_block(size);
+        nb->prev = b;
+        a->head = b = nb;
+        a->total += size;
+    }
+    void *p = (char *)b->data + b->used;
+    b->used += n;
+    return p;
+}
+
+char *arena_strndup(Arena *a, const char *s, size_t n) {
+    char *p = arena_alloc(a, n + 1);
+    memcpy(p, s, n);
+    p[n] = '\0';
+    return p;
+}
+
+char *arena_strdup(Arena *a, const char *s) {
+    return arena_strndup(a, s, strlen(s));
+}
+
+void arena_reset(Arena *a) {
+    if (!a->head) return;
+    if (a->head->prev) {
+        // Outgrown: replace the chain with one block that fits it all next time
+        size_t total = a->total;
+        arena_destroy(a);
+        a->head = new_block(total);
+        a->total = total;
+    }
+    a->head->used = 0;
+}
+
+void arena_destroy(Arena *a) {
+    for (ArenaBlock *b = a->head; b; ) {
+        ArenaBlock *prev = b->prev;
+        free(b);
+        b = prev;
+    }
+    a->head = NULL;
+    a->total = 0;
+}
@@ -0,0 +1,282 @@
+#define _GNU_SOURCE
+#include "tokenize.h"
+#include "parse.h"
+#include "plancache.h"
+#include "exec.h"
+#include "net.h"
+#include "arena.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+// Microbenchmarks for the hot paths a command takes from the socket to fork():
+// each sample times a batch of calls, warmup samples are dropped, and every
+// benchmark prints one line of key=value pairs (like FRAME_STATS) with the
+// median and p99 per call, e.g.
+//   bench=tokenize_short samples=200 ops=1000 median_ns=412.3 p99_ns=530.1 ...
+
+#define BENCH_GLOB_FILES 256    // Files in the scratch directory globbed by glob_*
+
+static Arena g_arena;
+static PlanCache g_plans;
+static int g_sock[2] = { -1, -1 };
+static char g_glob_pattern[4096];
+static char *g_long_line;
+
+static const char *SHORT_LINE = "ls -la /tmp | grep foo > out.txt";
+static const char *PIPELINE_LINE = "cat a.txt | grep -v 'x y' | sort -r | uniq -c >> counts.txt 2> err.txt";
+static const char *LIST_LINE = "make && ./run --fast || (echo failed; exit 1); echo done";
+
+static void bench_tokenize_short(void) {
+    QTok *toks;
+    int n;
+    qtokenize(&g_arena, SHORT_LINE, &toks, &n);
+    arena_reset(&g_arena);
+}
+
+static void bench_tokenize_long(void) {
+    QTok *toks;
+    int n;
+    qtokenize(&g_arena, g_long_line, &toks, &n);
+    arena_reset(&g_arena);
+}
+
+static void bench_plan_single(void) {
+    Plan plan;
+    parse_plan(&g_arena, "ls -la /tmp > out.txt", PLAN_AUTO, &plan);
+    arena_reset(&g_arena);
+}
+
+static void bench_parse_pipeline(void) {
+    Plan plan;
+    parse_plan(&g_arena, PIPELINE_LINE, PLAN_AUTO, &plan);
+    arena_reset(&g_arena);
+}
+
+// The pipe-structure checks fail this one before any stage is built
+static void bench_plan_reject_pipe(void) {
+    Plan plan;
+    parse_plan(&g_arena, "ls -la | | wc -l", PLAN_AUTO, &plan);
+    arena_reset(&g_arena);
+}
+
+static void bench_parse_list(void) {
+    CmdList list;
+    parse_list(&g_arena, LIST_LINE, &list);
+    arena_reset(&g_arena);
+}
+
+static void bench_plan_cache_hit(void) {
+    PlanEntry *e = plan_cache_lookup(&g_plans, PIPELINE_LINE);
+    if (e) plan_cache_release(&g_plans, e);
+}
+
+static void bench_glob_dir(void) {
+    char *words[] = { g_glob_pattern, NULL };
+    bool quoted[] = { false };
+    int argc = 1, s, e;
+    apply_globbing(&g_arena, words, quoted, &argc, &s, &e);
+    arena_reset(&g_arena);
+}
+
+static void bench_net_line(void) {
+    char buf[MAX_BUFFER_SIZE];
+    send_line(g_sock[0], SHORT_LINE);
+    receive_line(g_sock[1], buf, sizeof(buf));
+}
+
+static void bench_net_frame_4k(void) {
+    static char payload[4096], buf[8192];
+    int type;
+    send_frame(g_sock[0], FRAME_DATA, payload, sizeof(payload));
+    receive_frame(g_sock[1], &type, buf, sizeof(buf));
+}
+
+static void bench_spawn_command(void) {
+    char *args[] = { "true", NULL };
+    ExecResult res;
+    exec_result_init(&res, 0);
+    execute_command(args, NULL, NULL, NULL, 0, EXEC_CAPTURE, &res);
+    exec_result_free(&res);
+}
+
+static void bench_spawn_pipeline(void) {
+    char cmd[] = "true | true | true";
+    ExecResult res;
+    exec_result_init(&res, 0);
+    execute_pipeline(cmd, EXEC_CAPTURE, &res);
+    exec_result_free(&res);
+}
+
+typedef struct {
+    const char *name;
+    void (*fn)(void);
+    int ops;        // Calls per sample: enough that a sample is well above timer resolution
+} Bench;
+
+static const Bench BENCHES[] = {
+    { "tokenize_short",   bench_tokenize_short,    1000 },
+    { "tokenize_long",    bench_tokenize_long,     50 },
+    { "plan_single",      bench_plan_single,       1000 },
+    { "parse_pipeline",   bench_parse_pipeline,    500 },
+    { "plan_reject_pipe", bench_plan_reject_pipe,  1000 },
+    { "parse_list",       bench_parse_list,        1000 },
+    { "plan_cache_hit",   bench_plan_cache_hit,    5000 },
+    { "glob_dir",         bench_glob_dir,          20 },
+    { "net_line",         bench_net_line,          200 },
+    { "net_frame_4k",     bench_net_frame_4k,      100 },
+    { "spawn_command",    bench_spawn_command,     1 },
+    { "spawn_pipeline",   bench_spawn_pipeline,    1 },
+};
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Nearest-rank percentile of sorted v
+static double percentile(const double *v, int n, double p) {
+    int i = (int)(p / 100 * n + 0.999999) - 1;
+    if (i < 0) i = 0;
+    if (i >= n) i = n - 1;
+    return v[i];
+}
+
+static void run_bench(const Bench *b, int samples, int warmup, int scale) {
+    int ops = b->ops * scale / 100;
+    if (ops < 1) ops = 1;
+    double *ns = malloc(samples * sizeof(double));
+    if (!ns) {
+        perror("malloc");
+        exit(1);
+    }
+    for (int s = -warmup; s < samples; s++) {
+        double t0 = now_ns();
+        for (int i = 0; i < ops; i++) b->fn();
+        double per_op = (now_ns() - t0) / ops;
+        if (s >= 0) ns[s] = per_op;
+    }
+    double sum = 0;
+    for (int s = 0; s < samples; s++) sum += ns[s];
+    qsort(ns, samples, sizeof(double), cmp_double);
+    printf("bench=%s samples=%d ops=%d median_ns=%.1f p99_ns=%.1f min_ns=%.1f mean_ns=%.1f max_ns=%.1f\n",
+           b->name, samples, ops, percentile(ns, samples, 50), percentile(ns, samples, 99),
+           ns[0], sum / samples, ns[samples - 1]);
+    fflush(stdout);
+    free(ns);
+}
+
+// Scratch directory of BENCH_GLOB_FILES files for the glob benchmark
+static char *make_glob_dir(void) {
+    static char dir[] = "/tmp/bench-glob-XXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return NULL;
+    }
+    char path[4096];
+    for (int i = 0; i < BENCH_GLOB_FILES; i++) {
+        snprintf(path, sizeof(path), "%s/file%03d.%s", dir, i, i % 2 ? "c" : "h");
+        int fd = open(path, O_CREAT | O_WRONLY, 0644);
+        if (fd >= 0) close(fd);
+    }
+    snprintf(g_glob_pattern, sizeof(g_glob_pattern), "%s/file*.c", dir);
+    // Backdate it: the listing cache does not trust a directory modified within
+    // the last second, and this measures the steady state
+    struct timeval tv[2] = { { time(NULL) - 60, 0 }, { time(NULL) - 60, 0 } };
+    utimes(dir, tv);
+    return dir;
+}
+
+static void remove_glob_dir(const char *dir) {
+    char path[4096];
+    for (int i = 0; i < BENCH_GLOB_FILES; i++) {
+        snprintf(path, sizeof(path), "%s/file%03d.%s", dir, i, i % 2 ? "c" : "h");
+        unlink(path);
+    }
+    rmdir(dir);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-n samples] [-w warmup] [-s scale_pct] [-l] [bench...]\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    int samples = 200, warmup = 20, scale = 100, list = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:w:s:l")) != -1) {
+        switch (opt) {
+            case 'n': samples = atoi(optarg); break;
+            case 'w': warmup = atoi(optarg); break;
+            case 's': scale = atoi(optarg); break;   // Percent of each benchmark's ops per sample
+            case 'l': list = 1; break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (samples < 1 || warmup < 0 || scale < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    int nbench = sizeof(BENCHES) / sizeof(BENCHES[0]);
+    if (list) {
+        for (int i = 0; i < nbench; i++) printf("%s\n", BENCHES[i].name);
+        return 0;
+    }
+
+    // A 4 KB line of plain, quoted and escaped words and operators
+    size_t cap = 4096 + 64, len = 0;
+    g_long_line = malloc(cap);
+    if (!g_long_line) {
+        perror("malloc");
+        return 1;
+    }
+    static const char *chunks[] = { "grep -n pattern ", "'single quoted words' ", "\"double \\\"q\\\"\" ", "| sort ", "> out.txt " };
+    for (int i = 0; len < 4096; i++) {
+        const char *c = chunks[i % 5];
+        memcpy(g_long_line + len, c, strlen(c));
+        len += strlen(c);
+    }
+    g_long_line[len] = '\0';
+
+    plan_cache_init(&g_plans, PLAN_CACHE_DEFAULT_ENTRIES);
+    Plan plan;
+    if (parse_plan(&g_arena, PIPELINE_LINE, PLAN_AUTO, &plan) == 0) plan_cache_insert(&g_plans, PIPELINE_LINE, &plan);
+    arena_reset(&g_arena);
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, g_sock) < 0) perror("socketpair");
+    char *glob_dir = make_glob_dir();
+
+    for (int i = 0; i < nbench; i++) {
+        const Bench *b = &BENCHES[i];
+        int wanted = optind == argc;
+        for (int j = optind; j < argc; j++) {
+            if (strcmp(argv[j], b->name) == 0) wanted = 1;
+        }
+        if (!wanted) continue;
+        if ((strncmp(b->name, "net_", 4) == 0 && g_sock[0] < 0) || (strncmp(b->name, "glob_", 5) == 0 && !glob_dir)) {
+            continue;
+        }
+        run_bench(b, samples, warmup, scale);
+    }
+
+    if (glob_dir) remove_glob_dir(glob_dir);
+    close_socket(g_sock[0]);
+    close_socket(g_sock[1]);
+    plan_cache_destroy(&g_plans);
+    arena_destroy(&g_arena);
+    free(g_long_line);
+    return 0;
+}
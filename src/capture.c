@@ -0,0 +1,186 @@
+#define _GNU_SOURCE
+#include "capture.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+#define CAPTURE_INITIAL_SIZE 4096
+#define CAPTURE_COPY_CHUNK 65536
+
+void capture_init(Capture *c, size_t limit) {
+    c->mem = NULL;
+    c->cap = 0;
+    c->len = 0;
+    c->spill_fd = -1;
+    c->limit = limit;
+    c->truncated = 0;
+    c->marked = 0;
+}
+
+void capture_free(Capture *c) {
+    free(c->mem);
+    if (c->spill_fd >= 0) close(c->spill_fd);
+    capture_init(c, c->limit);
+}
+
+// Moves the in-memory bytes into a fresh memfd. On failure the capture simply
+// stays in memory (still bounded by the limit).
+static int capture_spill(Capture *c) {
+    int fd = memfd_create("mysh-capture", MFD_CLOEXEC);
+    if (fd < 0) return -1;
+    size_t done = 0;
+    while (done < c->len) {
+        ssize_t w = write(fd, c->mem + done, c->len - done);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            close(fd);
+            return -1;
+        }
+        done += w;
+    }
+    free(c->mem);
+    c->mem = NULL;
+    c->cap = 0;
+    c->spill_fd = fd;
+    return 0;
+}
+
+// Makes room for n more in-memory bytes, spilling once past CAPTURE_MEM_MAX.
+static int capture_reserve(Capture *c, size_t n) {
+    if (c->spill_fd >= 0) return 0;
+    if (c->len + n > CAPTURE_MEM_MAX && capture_spill(c) == 0) return 0;
+    if (c->len + n <= c->cap) return 0;
+    size_t cap = c->cap ? c->cap : CAPTURE_INITIAL_SIZE;
+    while (cap < c->len + n) cap *= 2;
+    char *p = realloc(c->mem, cap);
+    if (!p) {
+        perror("realloc");
+        return -1;
+    }
+    c->mem = p;
+    c->cap = cap;
+    return 0;
+}
+
+static int capture_write_spill(Capture *c, const char *data, size_t n) {
+    while (n > 0) {
+        ssize_t w = pwrite(c->spill_fd, data, n, c->len);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        c->len += w;
+        data += w;
+        n -= w;
+    }
+    return 0;
+}
+
+static int capture_store(Capture *c, const char *data, size_t n) {
+    if (capture_reserve(c, n) < 0) return -1;
+    if (c->spill_fd >= 0) return capture_write_spill(c, data, n);
+    memcpy(c->mem + c->len, data, n);
+    c->len += n;
+    return 0;
+}
+
+int capture_append(Capture *c, const char *data, size_t n) {
+    if (c->limit && c->len + n > c->limit) {
+        // len can already be past the limit by the size of the marker
+        n = c->len < c->limit ? c->limit - c->len : 0;
+        c->truncated = 1;
+    }
+    return n ? capture_store(c, data, n) : 0;
+}
+
+ssize_t capture_fill(Capture *c, int fd) {
+    if (c->truncated) return 0;
+
+    size_t room = !c->limit ? (size_t)-1 : c->len < c->limit ? c->limit - c->len : 0;
+    if (room == 0) {
+        // At the limit: one probe tells EOF apart from output we have to drop
+        char probe;
+        ssize_t r = read(fd, &probe, 1);
+        if (r > 0) c->truncated = 1;
+        return r < 0 ? -1 : 0;
+    }
+
+    // Once spilled, move pipe data straight into the memfd without a userspace copy
+    if (c->spill_fd >= 0) {
+        loff_t off = c->len;
+        size_t want = room < CAPTURE_COPY_CHUNK ? room : CAPTURE_COPY_CHUNK;
+        ssize_t s = splice(fd, NULL, c->spill_fd, &off, want, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (s > 0) {
+            c->len += s;
+            return s;
+        }
+        if (s == 0) return 0;
+        if (errno != EINVAL && errno != ESPIPE) return -1;
+        // fd is not a pipe: fall through to a plain read
+    }
+
+    char buf[CAPTURE_COPY_CHUNK];
+    size_t want = room < sizeof(buf) ? room : sizeof(buf);
+    ssize_t r = read(fd, buf, want);
+    if (r <= 0) return r;
+    if (capture_store(c, buf, r) < 0) return -1;
+    return r;
+}
+
+void capture_finish(Capture *c) {
+    if (!c->truncated || c->marked) return;
+    c->marked = 1;
+    char marker[128];
+    int n = snprintf(marker, sizeof(marker), CAPTURE_TRUNC_MARKER, c->limit);
+    // The marker itself is not subject to the limit
+    capture_store(c, marker, n);
+}
+
+ssize_t capture_pread(const Capture *c, char *buf, size_t n, off_t off) {
+    if ((size_t)off >= c->len) return 0;
+    if (n > c->len - off) n = c->len - off;
+    if (c->spill_fd < 0) {
+        memcpy(buf, c->mem + off, n);
+        return n;
+    }
+    return pread(c->spill_fd, buf, n, off);
+}
+
+int capture_write(const Capture *c, int fd) {
+    char buf[CAPTURE_COPY_CHUNK];
+    for (size_t off = 0; off < c->len; ) {
+        ssize_t n = capture_pread(c, buf, sizeof(buf), off);
+        if (n <= 0) return -1;
+        for (ssize_t done = 0; done < n; ) {
+            ssize_t w = write(fd, buf + done, n - done);
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                return -1;
+            }
+            done += w;
+        }
+        off += n;
+    }
+    return 0;
+}
+
+char *capture_to_string(const Capture *c) {
+    char *s = malloc(c->len + 1);
+    if (!s) {
+        perror("malloc");
+        return xstrdup("");
+    }
+    size_t done = 0;
+    while (done < c->len) {
+        ssize_t r = capture_pread(c, s + done, c->len - done, done);
+        if (r <= 0) break;
+        done += r;
+    }
+    s[done] = '\0';
+    return s;
+}
@@ -3,10 +3,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <signal.h>
+#include <getopt.h>
 
-#define MAX_CMD_LENGTH 1024 
 #define MAX_RESPONSE_LENGTH 65536
 
+#define STDIN_CHUNK 65536
+
 static int client_fd = -1;
 
 void signal_handler(int sig){
@@ -16,12 +18,95 @@ void signal_handler(int sig){
     exit(0);
 }
 
+// Prints one command's frames until the server's <<EOF>>. Returns -1 on disconnect.
+static int receive_output(char *response_buffer, int size, int verbose, int *last_status){
+    while(1) {
+        int type;
+        int bytes = receive_frame(client_fd, &type, response_buffer, size);
+        if(bytes < 0 || (bytes == 0 && type == FRAME_LINE)) return -1; // Error or disconnect
+
+        if(type == FRAME_DATA) {
+            // Raw command output: may be binary and need not end in a newline
+            fwrite(response_buffer, 1, bytes, stdout);
+            continue;
+        }
+        if(type == FRAME_STDERR) {
+            fflush(stdout);
+            fwrite(response_buffer, 1, bytes, stderr);
+            continue;
+        }
+        if(type == FRAME_STATS) {
+            // Per-stage resource accounting, shown with -v
+            if(verbose){
+                fflush(stdout);
+                fprintf(stderr, "[stats] %s\n", response_buffer);
+            }
+            continue;
+        }
+        if(type == FRAME_STATUS) {
+            // "exit=<n> ...": remember the last exit code for our own exit status
+            sscanf(response_buffer, "exit=%d", last_status);
+            continue;
+        }
+        
+        // Check for our custom End-Of-Transmission marker
+        if(strcmp(response_buffer, "<<EOF>>") == 0) {
+            fflush(stdout);
+            return 0;
+        }
+        
+        printf("%s\n", response_buffer); // Print output line
+    }
+}
+
+// Uploads our own stdin as FRAME_STDIN chunks, then the empty EOF frame. send()
+// blocks whenever the server-side pipe is full, so memory stays bounded on both ends.
+static int stream_stdin(void){
+    static char chunk[STDIN_CHUNK];
+    ssize_t n;
+    while((n = read(STDIN_FILENO, chunk, sizeof(chunk))) != 0){
+        if(n < 0){
+            if(errno == EINTR) continue;
+            perror("read stdin");
+            break;
+        }
+        if(send_frame(client_fd, FRAME_STDIN, chunk, n) < 0) return -1;
+    }
+    return send_frame(client_fd, FRAME_STDIN, "", 0);
+}
+
 int main(int argc, char *argv[]){
     char *server_ip = "127.0.0.1";
     int port = 8080;
-    char cmd_buffer[MAX_CMD_LENGTH];
+    char *cmd_buffer = NULL;  // getline() grows it to any command length
+    size_t cmd_size = 0;
     char response_buffer[MAX_RESPONSE_LENGTH];
-    (void)argc; (void)argv;
+    int last_status = 0;
+    int verbose = 0;
+    char *one_shot = NULL;
+    int upload_stdin = 0;
+
+    int opt;
+    while((opt = getopt(argc, argv, "vc:i")) != -1){
+        switch(opt){
+            case 'v':
+                verbose = 1;  // Print per-stage CPU/RSS/context-switch stats after each command
+                break;
+            case 'c':
+                one_shot = optarg;  // Run this single command and exit with its status
+                break;
+            case 'i':
+                upload_stdin = 1;  // With -c: stream our stdin into the command
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-v] [-c command [-i]]\n", argv[0]);
+                exit(1);
+        }
+    }
+    if(upload_stdin && !one_shot){
+        fprintf(stderr, "Error: -i requires -c\n");
+        exit(1);
+    }
 
     signal(SIGINT, signal_handler);
 
@@ -31,31 +116,33 @@ int main(int argc, char *argv[]){
         exit(1);
     }
 
+    if(one_shot){
+        int type = upload_stdin ? FRAME_CMD_STDIN : FRAME_LINE;
+        if(send_frame(client_fd, type, one_shot, strlen(one_shot)) < 0 ||
+           (upload_stdin && stream_stdin() < 0) ||
+           receive_output(response_buffer, sizeof(response_buffer), verbose, &last_status) < 0){
+            fprintf(stderr, "Error: connection lost\n");
+            last_status = 1;
+        }
+        close_socket(client_fd);
+        return last_status < 0 ? 1 : last_status;
+    }
+
     while(1){
         printf("$ ");
         fflush(stdout);
 
-        if(fgets(cmd_buffer, sizeof(cmd_buffer), stdin) == NULL) break;
+        if(getline(&cmd_buffer, &cmd_size, stdin) < 0) break;
         cmd_buffer[strcspn(cmd_buffer, "\n")] = '\0';
         if(strlen(cmd_buffer) == 0) continue;
 
         if(send_line(client_fd, cmd_buffer) < 0) break;
         if(strcmp(cmd_buffer, "exit") == 0) break;
         
-        // Loop to receive multi-line output until server says "CMD_DONE"
-        while(1) {
-            int bytes = receive_line(client_fd, response_buffer, sizeof(response_buffer));
-            if(bytes <= 0) break; // Error or disconnect
-            
-            // Check for our custom End-Of-Transmission marker
-            if(strcmp(response_buffer, "<<EOF>>") == 0) {
-                break;
-            }
-            
-            printf("%s\n", response_buffer); // Print output line
-        }
+        if(receive_output(response_buffer, sizeof(response_buffer), verbose, &last_status) < 0) break;
     }
 
+    free(cmd_buffer);
     close_socket(client_fd);
-    return 0;
+    return last_status < 0 ? 1 : last_status;
 }
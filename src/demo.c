@@ -1,21 +1,228 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <math.h>
+#include <stdint.h>
+#include <time.h>
+
+// Synthetic workload for the scheduler: N ticks, each a CPU phase (a real compute
+// kernel), an I/O phase and a sleep for the rest of the tick, printing "Demo i/N"
+// per tick like the jobs the server simulates. `demo N` is N one-second ticks of
+// pure CPU.
+
+#define KERNEL_DIM 32   // Side of the matrices multiplied when no memory is set
+
+typedef enum { DIST_FIXED, DIST_UNIFORM, DIST_EXP, DIST_PARETO } Dist;
+
+typedef struct {
+    int ticks;            // N, or the mean when a distribution is given
+    int tick_ms;
+    int cpu_pct;          // Share of each tick spent computing
+    size_t mem_bytes;     // Working set the kernel streams over (0 = matrix kernel)
+    size_t write_bytes;   // Written and fdatasync'd per tick
+    size_t out_bytes;     // Extra stdout per tick, beyond the Demo line
+    Dist dist;
+    double jitter;        // CPU phase varies by up to +-jitter of its length
+    unsigned long seed;
+    int verbose;
+} Workload;
+
+static uint64_t rng_state;
+
+// xorshift64*: reproducible with -s, good enough for burst shapes
+static double rng_uniform(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return ((rng_state * 2685821657736338717ULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Number of ticks for this run, drawn with mean w->ticks
+static int draw_ticks(const Workload *w) {
+    double mean = w->ticks, u = rng_uniform();
+    double t;
+    switch (w->dist) {
+        case DIST_UNIFORM: t = u * 2 * mean; break;
+        case DIST_EXP:     t = -mean * log(1 - u); break;
+        // Shape 1.5 (heavy tail: mostly short jobs, a few very long ones), scaled to the mean
+        case DIST_PARETO:  t = mean / 3 / pow(1 - u, 1 / 1.5); break;
+        default:           t = mean;
+    }
+    return t < 1 ? 1 : (int)(t + 0.5);
+}
+
+static double now_ms(clockid_t clk) {
+    struct timespec ts;
+    clock_gettime(clk, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static volatile double g_sink;  // Keeps the kernels from being optimized away
+
+// One round of the compute kernel: a small dense matrix product, or a
+// multiply-add pass over the working set when one is configured
+static void kernel_round(double *mem, size_t n) {
+    if (mem) {
+        double acc = 0;
+        for (size_t i = 0; i < n; i += 8) {
+            mem[i] = mem[i] * 1.000001 + 0.5;
+            acc += mem[i];
+        }
+        g_sink += acc;
+        return;
+    }
+    static double a[KERNEL_DIM][KERNEL_DIM], b[KERNEL_DIM][KERNEL_DIM], c[KERNEL_DIM][KERNEL_DIM];
+    for (int i = 0; i < KERNEL_DIM; i++) {
+        for (int k = 0; k < KERNEL_DIM; k++) {
+            double aik = a[i][k] + i - k;
+            for (int j = 0; j < KERNEL_DIM; j++) c[i][j] += aik * (b[k][j] + j);
+        }
+    }
+    g_sink += c[KERNEL_DIM - 1][KERNEL_DIM - 1];
+}
+
+// Burns cpu_ms of this process's CPU time (not wall time, so contention
+// stretches the phase the way it would stretch a real job)
+static void cpu_phase(double cpu_ms, double *mem, size_t n) {
+    double end = now_ms(CLOCK_PROCESS_CPUTIME_ID) + cpu_ms;
+    while (now_ms(CLOCK_PROCESS_CPUTIME_ID) < end) kernel_round(mem, n);
+}
+
+static void io_phase(int fd, size_t bytes) {
+    static char block[64 * 1024];
+    if (fd < 0 || bytes == 0) return;
+    lseek(fd, 0, SEEK_SET);
+    for (size_t left = bytes; left > 0; ) {
+        size_t chunk = left < sizeof(block) ? left : sizeof(block);
+        ssize_t w = write(fd, block, chunk);
+        if (w <= 0) {
+            perror("write");
+            return;
+        }
+        left -= w;
+    }
+    fdatasync(fd);
+}
+
+// Output volume beyond the Demo line: filler lines of 64 bytes
+static void output_phase(size_t bytes, int tick) {
+    char line[65];
+    for (size_t done = 0; done < bytes; done += 64) {
+        size_t len = bytes - done < 64 ? bytes - done : 64;
+        int n = snprintf(line, sizeof(line), "tick %d data %zu ", tick, done);
+        memset(line + n, 'x', 64 - n);
+        line[len - 1] = '\n';  // A short last line still ends the tick's output cleanly
+        fwrite(line, 1, len, stdout);
+    }
+}
+
+// Parses a size with an optional K, M or G suffix
+static size_t parse_size(const char *s) {
+    char *end;
+    double v = strtod(s, &end);
+    switch (*end) {
+        case 'k': case 'K': v *= 1024; break;
+        case 'm': case 'M': v *= 1024 * 1024; break;
+        case 'g': case 'G': v *= 1024.0 * 1024 * 1024; break;
+    }
+    return v > 0 ? (size_t)v : 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-t tick_ms] [-c cpu_pct] [-m mem] [-w write_bytes] [-o out_bytes]\n"
+            "       [-d fixed|uniform|exp|pareto] [-j jitter] [-s seed] [-v] <ticks>\n", prog);
+}
 
 int main(int argc, char *argv[]) {
-    if (argc < 2) {
-        printf("Usage: %s <seconds>\n", argv[0]);
+    Workload w = { .tick_ms = 1000, .cpu_pct = 100, .dist = DIST_FIXED, .seed = 0 };
+    int opt;
+    while ((opt = getopt(argc, argv, "t:c:m:w:o:d:j:s:v")) != -1) {
+        switch (opt) {
+            case 't': w.tick_ms = atoi(optarg); break;
+            case 'c': w.cpu_pct = atoi(optarg); break;
+            case 'm': w.mem_bytes = parse_size(optarg); break;
+            case 'w': w.write_bytes = parse_size(optarg); break;
+            case 'o': w.out_bytes = parse_size(optarg); break;
+            case 'd':
+                if (strcmp(optarg, "fixed") == 0) w.dist = DIST_FIXED;
+                else if (strcmp(optarg, "uniform") == 0) w.dist = DIST_UNIFORM;
+                else if (strcmp(optarg, "exp") == 0) w.dist = DIST_EXP;
+                else if (strcmp(optarg, "pareto") == 0) w.dist = DIST_PARETO;
+                else {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'j': w.jitter = atof(optarg); break;
+            case 's': w.seed = strtoul(optarg, NULL, 10); break;
+            case 'v': w.verbose = 1; break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
         return 1;
     }
-    int n = atoi(argv[1]);
+    w.ticks = atoi(argv[optind]);
+    if (w.tick_ms < 1 || w.cpu_pct < 0 || w.cpu_pct > 100 || w.jitter < 0 || w.jitter > 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    rng_state = w.seed ? w.seed : (uint64_t)time(NULL) ^ ((uint64_t)getpid() << 32);
+    if (!rng_state) rng_state = 1;
+    int n = w.ticks > 0 ? draw_ticks(&w) : 0;
+
+    // Touch every page up front so the footprint is resident, like a warmed-up job
+    double *mem = NULL;
+    size_t nmem = w.mem_bytes / sizeof(double);
+    if (nmem > 0) {
+        mem = malloc(nmem * sizeof(double));
+        if (!mem) {
+            perror("malloc");
+            return 1;
+        }
+        for (size_t i = 0; i < nmem; i++) mem[i] = (double)i;
+    }
+
+    int fd = -1;
+    if (w.write_bytes > 0) {
+        const char *dir = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/demo-XXXXXX", dir);
+        fd = mkstemp(path);
+        if (fd < 0) perror(path);
+        else unlink(path);
+    }
+
+    double wall0 = now_ms(CLOCK_MONOTONIC), cpu0 = now_ms(CLOCK_PROCESS_CPUTIME_ID);
     for (int i = 0; i < n; i++) {
-        // Output format matching screenshot: "Demo i/N"
+        double tick_start = now_ms(CLOCK_MONOTONIC);
+        double cpu_ms = w.tick_ms * w.cpu_pct / 100.0;
+        if (w.jitter > 0) cpu_ms *= 1 + w.jitter * (2 * rng_uniform() - 1);
+        cpu_phase(cpu_ms, mem, nmem);
+        io_phase(fd, w.write_bytes);
+
         printf("Demo %d/%d\n", i + 1, n);
-        fflush(stdout); 
-        // Note: The SERVER simulates the sleep. 
-        // This program is just for manual testing or if executed directly.
-        // In the Phase 4 logic, the server 'simulates' running this 
-        // by sleeping itself, but we provide this file as requested.
+        output_phase(w.out_bytes, i + 1);
+        fflush(stdout);
+
+        // Blocked for the rest of the tick (nothing left if the phases overran it)
+        double left = tick_start + w.tick_ms - now_ms(CLOCK_MONOTONIC);
+        if (left > 0) usleep((useconds_t)(left * 1000));
+    }
+    if (w.verbose) {
+        fprintf(stderr, "demo: ticks=%d wall_ms=%.1f cpu_ms=%.1f mem=%zu write=%zu out=%zu\n",
+                n, now_ms(CLOCK_MONOTONIC) - wall0, now_ms(CLOCK_PROCESS_CPUTIME_ID) - cpu0,
+                w.mem_bytes, w.write_bytes, w.out_bytes);
     }
+    if (fd >= 0) close(fd);
+    free(mem);
     return 0;
 }
@@ -1,282 +1,594 @@
+#define _GNU_SOURCE
 #include "exec.h"
 #include "parse.h"
 #include "redir.h"
 #include "util.h"
 #include "errors.h"
+#include "capture.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/wait.h>
+#include <signal.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
 
-#define MAX_CMD_LENGTH 1024 
-#define MAX_ARGS 64         
-#define MAX_PIPES 10
-#define OUTPUT_BUFFER_SIZE 4096
-
-typedef struct {
-    char *args[MAX_ARGS];
-    char *inputFile;
-    char *outputFile;
-    char *errorFile;
-    int outputAppend;  // 1 for append (>>), 0 for truncate (>)
-} Stage;
-
-static char* skip_whitespace(char *str){
-    while(*str == ' ' || *str == '\t' || *str == '\n'){
-        str++;
-    }
-    return str;
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+void exec_result_init(ExecResult *res, size_t limit) {
+    res->validate_err = VALIDATE_SUCCESS;
+    res->parse_err = PARSE_SUCCESS;
+    res->nstages = 0;
+    res->stages = NULL;
+    res->exit_status = -1;
+    capture_init(&res->out, limit);
+    capture_init(&res->err, limit);
+}
+
+void exec_result_free(ExecResult *res) {
+    free(res->stages);
+    res->stages = NULL;
+    res->nstages = 0;
+    capture_free(&res->out);
+    capture_free(&res->err);
 }
 
-static char* read_output_from_fd(int fd) {
-    size_t capacity = OUTPUT_BUFFER_SIZE;
-    size_t total_read = 0;
-    char *buffer = malloc(capacity);
-    if (!buffer) {
-        perror("malloc");
-        return NULL;
+const char *exec_error_message(const ExecResult *res) {
+    switch (res->validate_err) {
+        case VALIDATE_SUCCESS: break;
+        case VALIDATE_ERR_STARTS_PIPE: return ERR_CMD_MISSING_BEFORE_PIPE;
+        case VALIDATE_ERR_EMPTY_CMD: return ERR_EMPTY_CMD_BETWEEN_PIPES;
+        case VALIDATE_ERR_ENDS_PIPE: return ERR_CMD_MISSING_AFTER_PIPE;
+        default: return ERR_CMD_MISSING_AFTER_PIPE;
     }
+    switch (res->parse_err) {
+        case PARSE_SUCCESS: return NULL;
+        case PARSE_ERR_NO_INPUT_FILE: return ERR_INPUT_NOT_SPECIFIED;
+        case PARSE_ERR_NO_OUTPUT_FILE: return ERR_OUTPUT_NOT_SPECIFIED;
+        case PARSE_ERR_NO_OUTPUT_FILE_AFTER: return ERR_OUT_AFTER;
+        case PARSE_ERR_NO_ERROR_FILE: return ERR_ERROR_NOT_SPECIFIED;
+        case PARSE_ERR_UNCLOSED_QUOTES: return ERR_UNCLOSED_QUOTES;
+        case PARSE_ERR_LIST_SYNTAX: return ERR_LIST_SYNTAX;
+        case PARSE_ERR_UNMATCHED_PAREN: return ERR_UNMATCHED_PAREN;
+        case PARSE_ERR_MISSING_BEFORE_BG: return ERR_CMD_MISSING_BEFORE_BG;
+        default: return "";
+    }
+}
 
-    ssize_t bytes_read;
-    while ((bytes_read = read(fd, buffer + total_read, capacity - total_read - 1)) > 0) {
-        total_read += bytes_read;
-        if (total_read >= capacity - 1) {
-            capacity *= 2;
-            char *new_buffer = realloc(buffer, capacity);
-            if (!new_buffer) {
-                perror("realloc");
-                free(buffer);
-                return NULL;
-            }
-            buffer = new_buffer;
+// Status 2 like other shells
+void exec_record_syntax_error(ExecResult *res) {
+    const char *msg = exec_error_message(res);
+    if (msg) capture_append(&res->err, msg, strlen(msg));
+    res->exit_status = 2;
+}
+
+static double elapsed_ms(const struct timespec *from, const struct timespec *to) {
+    return (to->tv_sec - from->tv_sec) * 1e3 + (to->tv_nsec - from->tv_nsec) / 1e6;
+}
+
+static double timeval_ms(const struct timeval *tv) {
+    return tv->tv_sec * 1e3 + tv->tv_usec / 1e3;
+}
+
+void exec_record_exit(StageResult *st, int status, const struct rusage *ru) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    st->wall_ms = elapsed_ms(&st->started, &now);
+    if (ru) st->ru = *ru;
+    if (WIFEXITED(status)) st->status = WEXITSTATUS(status);
+    else if (WIFSIGNALED(status)) st->status = 128 + WTERMSIG(status);
+    else st->status = -1;
+}
+
+// Reaps st->pid with wait4() and records its exit status (shell convention,
+// 128+sig if killed), wall time and resource usage.
+static void wait_stage(StageResult *st) {
+    int status;
+    struct rusage ru;
+    while (wait4(st->pid, &status, 0, &ru) < 0) {
+        if (errno != EINTR) {
+            st->status = -1;
+            return;
         }
     }
-    buffer[total_read] = '\0';
-    return buffer;
+    exec_record_exit(st, status, &ru);
 }
 
-char* execute_command(char *args[], char *inputFile, char *outputFile, char *errorFile, int outputAppend) {
-    int output_pipe[2];
-    if (pipe(output_pipe) < 0) {
-        perror("pipe failed");
-        return xstrdup("");
-    }
+int exec_format_stage_stats(const StageResult *st, char *buf, size_t size) {
+    return snprintf(buf, size, "pid=%d exit=%d wall_ms=%.3f user_ms=%.3f sys_ms=%.3f maxrss_kb=%ld vcsw=%ld ivcsw=%ld",
+                    (int)st->pid, st->status, st->wall_ms,
+                    timeval_ms(&st->ru.ru_utime), timeval_ms(&st->ru.ru_stime),
+                    st->ru.ru_maxrss, st->ru.ru_nvcsw, st->ru.ru_nivcsw);
+}
+
+// Backs the plan of the command being started. Each thread reuses its own, so
+// after the first few commands parsing no longer touches malloc().
+static __thread Arena plan_arena;
+
+// Parses cmd into plan (in plan_arena) in one pass. On a syntax error, records
+// it in res (status 2, message in res->err) and returns -1.
+static int build_plan(const char *cmd, int is_pipeline, Plan *plan, ExecResult *res) {
+    int rc = parse_plan(&plan_arena, cmd, is_pipeline, plan);
+    res->validate_err = plan->validate_err;
+    res->parse_err = plan->parse_err;
+    if (rc < 0) exec_record_syntax_error(res);
+    return rc;
+}
+
+// Bytes one argument takes from execve()'s budget: the string and its pointer
+static size_t arg_size(const char *s) {
+    return strlen(s) + 1 + sizeof(char *);
+}
 
-    pid_t pid = fork();
-    if (pid < 0) {
-        perror("fork failed");
-        close(output_pipe[0]);
-        close(output_pipe[1]);
-        return xstrdup("");
+// Room execve() leaves for argv: ARG_MAX less the environment and the same
+// 2 KB of headroom xargs keeps
+static size_t arg_budget(char *const *envp) {
+    long max = sysconf(_SC_ARG_MAX);
+    size_t used = 2048;
+    for (char *const *e = envp; *e; e++) used += arg_size(*e);
+    return max > 0 && (size_t)max > used ? (size_t)max - used : 0;
+}
+
+// Splits a stage whose glob matches push argv past budget into several runs, the
+// way xargs does: each run keeps the arguments before and after the matched span
+// and takes as many matches as fit (at least one). Returns the number of runs,
+// their argvs in *runs (in plan_arena), or 0 if the stage runs as it is.
+static int split_runs(const PlanStage *st, size_t budget, char ****runs_out) {
+    if (st->batch_end <= st->batch_start) return 0;
+    int argc = 0;
+    size_t total = sizeof(char *), fixed = sizeof(char *);
+    for (; st->args[argc]; argc++) {
+        total += arg_size(st->args[argc]);
+        if (argc < st->batch_start || argc >= st->batch_end) fixed += arg_size(st->args[argc]);
     }
-    
-    if (pid == 0) { // Child process
-        close(output_pipe[0]);
+    if (total <= budget) return 0;
 
-        if (!outputFile) {
-            dup2(output_pipe[1], STDOUT_FILENO);
-        }
-        if (!errorFile) {
-            dup2(output_pipe[1], STDERR_FILENO);
-        }
-        
-        if (inputFile && setup_redirection(inputFile, O_RDONLY, STDIN_FILENO) < 0) {
-            exit(EXIT_FAILURE);
-        }
-        if (outputFile) {
-            int flags = O_WRONLY | O_CREAT;
-            flags |= outputAppend ? O_APPEND : O_TRUNC;
-            if (setup_redirection(outputFile, flags, STDOUT_FILENO) < 0) {
-                exit(EXIT_FAILURE);
-            }
-        }
-        if (errorFile && setup_redirection(errorFile, O_WRONLY | O_CREAT | O_TRUNC, STDERR_FILENO) < 0) {
-            exit(EXIT_FAILURE);
-        }
-        
-        close(output_pipe[1]);
-        
-        if (execvp(args[0], args) < 0) {
-            dprintf(STDERR_FILENO, "Command not found: %s\n", args[0]);
-            _exit(127);
+    int nprefix = st->batch_start, nsuffix = argc - st->batch_end;
+    char ***runs = NULL;
+    int n = 0, cap = 0;
+    for (int i = st->batch_start; i < st->batch_end; ) {
+        int j = i;
+        size_t size = fixed + arg_size(st->args[j++]);
+        while (j < st->batch_end && size + arg_size(st->args[j]) <= budget) size += arg_size(st->args[j++]);
+
+        char **argv = arena_alloc(&plan_arena, (nprefix + (j - i) + nsuffix + 1) * sizeof(char *));
+        memcpy(argv, st->args, nprefix * sizeof(char *));
+        memcpy(argv + nprefix, st->args + i, (j - i) * sizeof(char *));
+        memcpy(argv + nprefix + (j - i), st->args + st->batch_end, (nsuffix + 1) * sizeof(char *));
+        if (n == cap) {
+            cap = cap ? cap * 2 : 8;
+            char ***tmp = arena_alloc(&plan_arena, cap * sizeof(char **));
+            if (n) memcpy(tmp, runs, n * sizeof(char **));
+            runs = tmp;
         }
-    } else { // Parent process
-        close(output_pipe[1]);
-        
-        char *output = read_output_from_fd(output_pipe[0]);
-        
-        close(output_pipe[0]);
-        wait(NULL);
-        
-        return output;
+        runs[n++] = argv;
+        i = j;
     }
-    return xstrdup("");
+    *runs_out = runs;
+    return n;
 }
 
-char* execute_pipeline(char *cmd, int client_fd) {
-    (void)client_fd;  // Explicitly mark as unused
-    int validation_err = validate_pipeline(cmd);
-    if (validation_err != VALIDATE_SUCCESS) {
-        switch (validation_err) {
-            case VALIDATE_ERR_STARTS_PIPE:
-                return xstrdup(ERR_CMD_MISSING_BEFORE_PIPE);
-            case VALIDATE_ERR_EMPTY_CMD:
-                return xstrdup(ERR_EMPTY_CMD_BETWEEN_PIPES);
-            case VALIDATE_ERR_ENDS_PIPE:
-                return xstrdup(ERR_CMD_MISSING_AFTER_PIPE);
-            default:
-                return xstrdup(ERR_CMD_MISSING_AFTER_PIPE);
-        }
+// Execs argv in a stage's child (path from attr->resolve if any; a stale one
+// falls back to the PATH search). Returns only after reporting a failure.
+static void exec_argv(const char *path, char **argv, int is_pipeline) {
+    if (path) execve(path, argv, environ);
+    execvp(argv[0], argv);
+    // execvp failed - write error to stderr (which goes to the capture pipe)
+    if (is_pipeline) {
+        dprintf(STDERR_FILENO, "Command not found in pipe sequence: %s\n", argv[0]);
+    } else {
+        dprintf(STDERR_FILENO, "Command not found: %s\n", argv[0]);
     }
-    
-    Stage stages[MAX_PIPES];
-    int numStages = 0;
-    
-    char *saveptr;
-    char *stage_cmd = strtok_r(cmd, "|", &saveptr);
-    
-    while (stage_cmd != NULL && numStages < MAX_PIPES) {
-        stage_cmd = skip_whitespace(stage_cmd);
-        stages[numStages].outputAppend = 0;  // Initialize to truncate mode
-        int parse_res = parse_command(stage_cmd, stages[numStages].args, &stages[numStages].inputFile, &stages[numStages].outputFile, &stages[numStages].errorFile, 1, &stages[numStages].outputAppend);
-        if (parse_res != PARSE_SUCCESS) {
-            for (int i = 0; i < numStages; i++) {
-                for (int j = 0; stages[i].args[j] != NULL; j++) free(stages[i].args[j]);
-                if(stages[i].inputFile) free(stages[i].inputFile);
-                if(stages[i].outputFile) free(stages[i].outputFile);
-                if(stages[i].errorFile) free(stages[i].errorFile);
-            }
-            switch (parse_res) {
-                case PARSE_ERR_NO_INPUT_FILE: return xstrdup(ERR_INPUT_NOT_SPECIFIED);
-                case PARSE_ERR_NO_OUTPUT_FILE: return xstrdup(ERR_OUTPUT_NOT_SPECIFIED);
-                case PARSE_ERR_NO_OUTPUT_FILE_AFTER: return xstrdup(ERR_OUT_AFTER);
-                case PARSE_ERR_NO_ERROR_FILE: return xstrdup(ERR_ERROR_NOT_SPECIFIED);
-                case PARSE_ERR_UNCLOSED_QUOTES: return xstrdup(ERR_UNCLOSED_QUOTES);
-                default: return xstrdup("");
-            }
+}
+
+// Runs the argvs one after another from a stage's child, which they share
+// redirections, pipes and process group with. Returns the first non-zero status
+// (stopping early if a run could not exec or was killed), or 0.
+static int run_split(const char *path, char ***runs, int nruns, int is_pipeline) {
+    int status = 0;
+    for (int r = 0; r < nruns; r++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork failed");
+            return 126;
+        }
+        if (pid == 0) {
+            exec_argv(path, runs[r], is_pipeline);
+            _exit(127);
         }
-        numStages++;
-        stage_cmd = strtok_r(NULL, "|", &saveptr);
+        int ws;
+        while (waitpid(pid, &ws, 0) < 0 && errno == EINTR) {}
+        int st = WIFSIGNALED(ws) ? 128 + WTERMSIG(ws) : WEXITSTATUS(ws);
+        if (st != 0 && status == 0) status = st;
+        if (st == 127 || WIFSIGNALED(ws)) break;
     }
-    
-    if (numStages == 0) return xstrdup("");
+    return status;
+}
 
-    int capture_pipe[2];
-    if (pipe(capture_pipe) < 0) {
-        perror("capture pipe failed");
-        return xstrdup("");
-    }
+static int run_group(const PlanGroup *g);
 
-    int pipes[numStages - 1][2];
+// Forks one child per stage and wires the inter-stage pipes. In capture mode
+// (out_fd >= 0) the last stage's stdout goes to out_fd and every stage's stderr
+// to err_fd; otherwise they are inherited from the caller, exactly like a job in
+// a real shell. When null_stdin is set the first stage reads /dev/null unless
+// redirected, or attr->stdin_fd when one is given. With attr->pgrp the stages
+// form their own process group (set in both parent and child, so neither can
+// race ahead). attr->child_setup (if any) runs in each child before exec;
+// attr->envp and attr->resolve pick the environment and executable. A stage
+// whose argv exceeds ARG_MAX is split into sequential runs (see split_runs), and
+// a ( list ) stage runs its pipelines in the child (see run_group).
+// Returns the number of children started; results[] receives their pids and
+// start times.
+static int spawn_stages(PlanStage *stages, int numStages, int out_fd, int err_fd, int null_stdin, int is_pipeline, const ExecAttr *attr, StageResult results[]) {
+    int pipes[numStages > 1 ? numStages - 1 : 1][2];
     for (int i = 0; i < numStages - 1; i++) {
         if (pipe(pipes[i]) < 0) {
             perror("pipe failed");
-            return xstrdup("");
+            for (int j = 0; j < i; j++) {
+                close(pipes[j][0]);
+                close(pipes[j][1]);
+            }
+            return 0;
         }
     }
-    
-    pid_t pids[numStages];
+
+    int started = 0;
+    char *const *envp = attr && attr->envp ? attr->envp : environ;
+    size_t budget = 0;  // Computed for the first stage with glob matches
     for (int i = 0; i < numStages; i++) {
-        pids[i] = fork();
-        if (pids[i] < 0) {
+        // Resolved and split before fork(): the child of a threaded caller must not allocate
+        const char *path = NULL;
+        if (attr && attr->resolve && !stages[i].group && !strchr(stages[i].args[0], '/')) {
+            path = attr->resolve(attr->resolve_ctx, stages[i].args[0]);
+        }
+        char ***runs = NULL;
+        int nruns = 0;
+        if (stages[i].batch_end > stages[i].batch_start) {
+            if (!budget) budget = arg_budget(envp);
+            nruns = split_runs(&stages[i], budget, &runs);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &results[i].started);
+        results[i].pid = fork();
+        if (results[i].pid < 0) {
             perror("fork failed");
-            return xstrdup("");
-        } else if (pids[i] == 0) {
+            break;
+        } else if (results[i].pid == 0) {
             // CHILD PROCESS
-            close(capture_pipe[0]);
+
+            // The server ignores SIGPIPE and an interactive mysh ignores the
+            // terminal signals; commands must get the defaults back
+            signal(SIGPIPE, SIG_DFL);
+            signal(SIGINT, SIG_DFL);
+            signal(SIGQUIT, SIG_DFL);
+            if (attr && attr->pgrp) {
+                setpgid(0, i == 0 ? 0 : results[0].pid);
+                // Still ignoring SIGTTOU here, so taking the terminal cannot stop us
+                if (attr->foreground && i == 0) tcsetpgrp(STDIN_FILENO, getpgrp());
+                signal(SIGTSTP, SIG_DFL);
+                signal(SIGTTIN, SIG_DFL);
+                signal(SIGTTOU, SIG_DFL);
+            }
+            if (attr && attr->child_setup) attr->child_setup(attr->arg);
 
             // Setup STDIN: first stage gets /dev/null if no explicit input redirection
-            if (i == 0) {
-                if (!stages[i].inputFile) {
-                    // Feed EOF to first stage to prevent blocking on user input
-                    int devnull = open("/dev/null", O_RDONLY);
-                    if (devnull >= 0) {
-                        dup2(devnull, STDIN_FILENO);
-                        close(devnull);
-                    }
-                } else {
-                    if(setup_redirection(stages[i].inputFile, O_RDONLY, STDIN_FILENO) < 0) _exit(EXIT_FAILURE);
-                }
-            } else {
+            if (stages[i].inputFile) {
+                if(setup_redirection(stages[i].inputFile, O_RDONLY, STDIN_FILENO) < 0) _exit(EXIT_FAILURE);
+            } else if (i > 0) {
                 // Connect to previous stage's pipe
-                if (!stages[i].inputFile) {
-                    dup2(pipes[i - 1][0], STDIN_FILENO);
-                } else {
-                    if(setup_redirection(stages[i].inputFile, O_RDONLY, STDIN_FILENO) < 0) _exit(EXIT_FAILURE);
+                dup2(pipes[i - 1][0], STDIN_FILENO);
+            } else if (attr && attr->stdin_fd >= 0) {
+                // Caller-supplied input stream (e.g. uploaded by a remote client)
+                dup2(attr->stdin_fd, STDIN_FILENO);
+            } else if (null_stdin) {
+                // Feed EOF to first stage to prevent blocking on user input
+                int devnull = open("/dev/null", O_RDONLY);
+                if (devnull >= 0) {
+                    dup2(devnull, STDIN_FILENO);
+                    close(devnull);
                 }
             }
-            
-            // Setup STDOUT
-            if (i < numStages - 1) {
-                // Middle stages write to next pipe
-                if (!stages[i].outputFile) {
-                    dup2(pipes[i][1], STDOUT_FILENO);
-                } else {
-                    int flags = O_WRONLY | O_CREAT;
-                    flags |= stages[i].outputAppend ? O_APPEND : O_TRUNC;
-                    if(setup_redirection(stages[i].outputFile, flags, STDOUT_FILENO) < 0) _exit(EXIT_FAILURE);
-                }
-            } else {
-                // Last stage writes to capture pipe
-                if (!stages[i].outputFile) {
-                    dup2(capture_pipe[1], STDOUT_FILENO);
-                } else {
-                    int flags = O_WRONLY | O_CREAT;
-                    flags |= stages[i].outputAppend ? O_APPEND : O_TRUNC;
-                    if(setup_redirection(stages[i].outputFile, flags, STDOUT_FILENO) < 0) _exit(EXIT_FAILURE);
-                }
+
+            // Setup STDOUT: middle stages write to next pipe, last stage to the capture pipe
+            if (stages[i].outputFile) {
+                int flags = O_WRONLY | O_CREAT;
+                flags |= stages[i].outputAppend ? O_APPEND : O_TRUNC;
+                if(setup_redirection(stages[i].outputFile, flags, STDOUT_FILENO) < 0) _exit(EXIT_FAILURE);
+            } else if (i < numStages - 1) {
+                dup2(pipes[i][1], STDOUT_FILENO);
+            } else if (out_fd >= 0) {
+                dup2(out_fd, STDOUT_FILENO);
             }
 
-            // Setup STDERR: redirect to capture pipe so errors are collected with stdout
-            // We'll handle errors in the parent and send them via the protocol
-            if (!stages[i].errorFile) {
-                dup2(capture_pipe[1], STDERR_FILENO);
-            } else {
+            // Setup STDERR: kept apart from stdout so callers never have to classify output
+            if (stages[i].errorFile) {
                 if(setup_redirection(stages[i].errorFile, O_WRONLY|O_CREAT|O_TRUNC, STDERR_FILENO) < 0) _exit(EXIT_FAILURE);
+            } else if (err_fd >= 0) {
+                dup2(err_fd, STDERR_FILENO);
             }
-            
+
             // Close all pipe file descriptors in child (after dup2, we have copies)
             for (int j = 0; j < numStages - 1; j++) {
                 close(pipes[j][0]);
                 close(pipes[j][1]);
             }
-            close(capture_pipe[1]);
-            
+
             // Execute command
-            if (execvp(stages[i].args[0], stages[i].args) < 0) {
-                // execvp failed - write error to stderr (which goes to capture pipe)
-                dprintf(STDERR_FILENO, "Command not found in pipe sequence: %s\n", stages[i].args[0]);
-                _exit(127);
-            }
+            environ = (char **)envp;
+            if (stages[i].group) _exit(run_group(stages[i].group));
+            if (nruns > 0) _exit(run_split(path, runs, nruns, is_pipeline));
+            exec_argv(path, stages[i].args, is_pipeline);
+            _exit(127);
         }
         // PARENT: Continue spawning remaining stages regardless of previous results
+        if (attr && attr->pgrp) setpgid(results[i].pid, results[0].pid);
+        started++;
     }
-    
+
     // Close all pipe file descriptors in parent (children have what they need)
-    close(capture_pipe[1]);
     for (int i = 0; i < numStages - 1; i++) {
         close(pipes[i][0]);
         close(pipes[i][1]);
     }
-    
-    // Wait for all children to complete (handle failures gracefully)
-    for (int i = 0; i < numStages; i++) {
-        waitpid(pids[i], NULL, 0);
+    return started;
+}
+
+// Runs a ( list ) stage as a subshell, from the stage's child: its pipelines one
+// after another on the stage's stdin, stdout and stderr, each deciding from the
+// last status what runs next. Their plans were built before the fork, so nothing
+// is parsed here. `cd` moves this subshell only; a pipeline ended by & is not
+// waited for (status 0). Returns the last status.
+static int run_group(const PlanGroup *g) {
+    int status = 0, pos = 0;
+    while (list_next(&g->list, &pos, status)) {
+        const Plan *p = &g->plans[pos - 1];
+        char **args = p->stages[0].args;
+        if (p->nstages == 1 && !p->stages[0].group && strcmp(args[0], "cd") == 0) {
+            const char *dir = args[1] ? args[1] : getenv("HOME");
+            status = 0;
+            if (!dir || chdir(dir) < 0) {
+                perror(dir ? dir : "cd");
+                status = 1;
+            }
+            continue;
+        }
+        StageResult results[p->nstages];
+        int started = spawn_stages(p->stages, p->nstages, -1, -1, 0, p->nstages > 1, NULL, results);
+        if (g->list.steps[pos - 1].background) {
+            status = started == p->nstages ? 0 : 126;
+            continue;
+        }
+        for (int i = 0; i < started; i++) wait_stage(&results[i]);
+        status = started == p->nstages ? results[p->nstages - 1].status : 126;
     }
+    return status;
+}
 
-    // Read both stdout and stderr from capture pipe (they're both redirected there)
-    // This includes error messages from failed execvp calls
-    char* output = read_output_from_fd(capture_pipe[0]);
-    close(capture_pipe[0]);
+// pidfds[] marker for a running stage that has no pidfd and is reaped at finish
+#define PIDFD_NONE -2
 
-    for (int i = 0; i < numStages; i++) {
-        for (int j = 0; stages[i].args[j] != NULL; j++) free(stages[i].args[j]);
-        if(stages[i].inputFile) free(stages[i].inputFile);
-        if(stages[i].outputFile) free(stages[i].outputFile);
-        if(stages[i].errorFile) free(stages[i].errorFile);
+static int open_pidfd(pid_t pid) {
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+}
+
+// Closes one of the job's fds, dropping it from the job's epoll set first: a
+// forked-but-not-yet-exec'd child elsewhere may still share the open file, and
+// epoll would otherwise keep reporting it.
+static void job_close_fd(ExecJob *job, int *fd) {
+    if (*fd < 0) return;
+    if (job->epfd >= 0) epoll_ctl(job->epfd, EPOLL_CTL_DEL, *fd, NULL);
+    close(*fd);
+    *fd = -1;
+    job->pending--;
+}
+
+// Allocates per-stage results and forks the stages in the given mode. In capture
+// mode the job's pipes and pidfds are set up for exec_job_on_output()/on_exit().
+static int start_stages(PlanStage *stages, int numStages, int mode, int is_pipeline, const ExecAttr *attr, ExecResult *res, ExecJob *job) {
+    job->res = res;
+    job->out_fd = job->err_fd = -1;
+    job->pidfds = NULL;
+    job->pending = 0;
+    job->epfd = -1;
+    job->base = res->nstages;
+
+    StageResult *all = realloc(res->stages, (job->base + numStages) * sizeof(StageResult));
+    if (!all) {
+        perror("realloc");
+        return -1;
+    }
+    memset(all + job->base, 0, numStages * sizeof(StageResult));
+    res->stages = all;
+    res->nstages = job->base + numStages;
+    StageResult *results = all + job->base;
+
+    // O_CLOEXEC keeps the read ends out of the children, so closing them here
+    // really does break the pipe for writers that outlive the capture limit
+    int out_pipe[2] = { -1, -1 }, err_pipe[2] = { -1, -1 };
+    if (mode == EXEC_CAPTURE) {
+        if (pipe2(out_pipe, O_CLOEXEC) < 0 || pipe2(err_pipe, O_CLOEXEC) < 0) {
+            perror("capture pipe failed");
+            if (out_pipe[0] >= 0) { close(out_pipe[0]); close(out_pipe[1]); }
+            return -1;
+        }
+    } else {
+        fflush(stdout);  // Anything we buffered must land before the children's output
+    }
+
+    int null_stdin = (mode == EXEC_CAPTURE && is_pipeline);
+    int started = spawn_stages(stages, numStages, out_pipe[1], err_pipe[1], null_stdin, is_pipeline, attr, results);
+    for (int i = started; i < numStages; i++) {
+        results[i].pid = -1;
+        results[i].status = -1;
+    }
+
+    if (mode == EXEC_CAPTURE) {
+        close(out_pipe[1]);
+        close(err_pipe[1]);
+        job->out_fd = out_pipe[0];
+        job->err_fd = err_pipe[0];
+        job->pending = 2;
+        job->pidfds = malloc(numStages * sizeof(int));
+        for (int i = 0; job->pidfds && i < numStages; i++) {
+            // Without pidfd support (pre-5.3 kernels) the stage is reaped in exec_job_finish()
+            int pfd = -1;
+            if (i < started) {
+                pfd = open_pidfd(results[i].pid);
+                if (pfd < 0) pfd = PIDFD_NONE;
+            }
+            job->pidfds[i] = pfd;
+            if (pfd >= 0) job->pending++;
+        }
+    }
+    return started > 0 ? 0 : -1;
+}
+
+void exec_job_on_output(ExecJob *job, int fd) {
+    int *slot = (fd == job->out_fd) ? &job->out_fd : &job->err_fd;
+    Capture *c = (fd == job->out_fd) ? &job->res->out : &job->res->err;
+    if (*slot < 0) return;
+
+    ssize_t n = capture_fill(c, fd);
+    if (n < 0 && (errno == EINTR || errno == EAGAIN)) return;
+    if (n < 0) perror("read");
+    if (n <= 0) {
+        // EOF (all writers are gone), limit reached, or a hard error
+        job_close_fd(job, slot);
     }
+}
+
+void exec_job_on_exit(ExecJob *job, int stage) {
+    if (!job->pidfds || job->pidfds[stage] < 0) return;
+    wait_stage(&job->res->stages[job->base + stage]);  // Exited already: wait4() returns at once
+    job_close_fd(job, &job->pidfds[stage]);
+}
+
+void exec_job_finish(ExecJob *job) {
+    ExecResult *res = job->res;
+    job_close_fd(job, &job->out_fd);
+    job_close_fd(job, &job->err_fd);
+    for (int i = 0; i < res->nstages - job->base; i++) {
+        StageResult *st = &res->stages[job->base + i];
+        if (st->pid <= 0) continue;
+        if (!job->pidfds || job->pidfds[i] == PIDFD_NONE) {
+            wait_stage(st);
+        } else if (job->pidfds[i] >= 0) {
+            job_close_fd(job, &job->pidfds[i]);
+            wait_stage(st);
+        }
+    }
+    free(job->pidfds);
+    job->pidfds = NULL;
+    // Exit status of a pipeline is the status of its last stage (a run that never
+    // started keeps the status its syntax error recorded)
+    if (res->nstages > job->base) res->exit_status = res->stages[res->nstages - 1].status;
+}
+
+// Drives a capture-mode job to completion on the calling thread. Output is
+// drained with poll() while the stages run; a writer blocks once a pipe buffer
+// (~64 KB) is full, so the children must never be waited for first.
+static void exec_job_wait(ExecJob *job) {
+    int n = job->res->nstages - job->base;
+    struct pollfd pfd[n + 2];
+    int stage_of[n + 2];
+
+    while (job->pending > 0) {
+        int k = 0;
+        if (job->out_fd >= 0) { pfd[k] = (struct pollfd){ .fd = job->out_fd, .events = POLLIN }; stage_of[k++] = -1; }
+        if (job->err_fd >= 0) { pfd[k] = (struct pollfd){ .fd = job->err_fd, .events = POLLIN }; stage_of[k++] = -1; }
+        for (int i = 0; job->pidfds && i < n; i++) {
+            if (job->pidfds[i] < 0) continue;
+            pfd[k] = (struct pollfd){ .fd = job->pidfds[i], .events = POLLIN };
+            stage_of[k++] = i;
+        }
+        if (poll(pfd, k, -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+        for (int i = 0; i < k; i++) {
+            if (!pfd[i].revents) continue;
+            if (stage_of[i] < 0) exec_job_on_output(job, pfd[i].fd);
+            else exec_job_on_exit(job, stage_of[i]);
+        }
+    }
+    exec_job_finish(job);
+    capture_finish(&job->res->out);
+    capture_finish(&job->res->err);
+}
 
-    return output;
+// Runs parsed stages in the given mode and fills res with their statuses.
+static int run_stages(PlanStage *stages, int numStages, int mode, int is_pipeline, ExecResult *res) {
+    ExecJob job;
+    if (start_stages(stages, numStages, mode, is_pipeline, NULL, res, &job) < 0 && res->nstages == job.base) {
+        return res->exit_status = -1;
+    }
+    if (mode == EXEC_CAPTURE) {
+        exec_job_wait(&job);
+        return res->exit_status;
+    }
+
+    for (int i = job.base; i < res->nstages; i++) {
+        if (res->stages[i].pid > 0) wait_stage(&res->stages[i]);
+    }
+    // Exit status of a pipeline is the status of its last stage
+    res->exit_status = res->stages[res->nstages - 1].status;
+    return res->exit_status;
+}
+
+int execute_command(char *args[], char *inputFile, char *outputFile, char *errorFile, int outputAppend, int mode, ExecResult *res) {
+    PlanStage stage = { args, inputFile, outputFile, errorFile, outputAppend, 0, 0, NULL };
+    run_stages(&stage, 1, mode, 0, res);
+    arena_reset(&plan_arena);
+    return res->exit_status;
+}
+
+int execute_pipeline(char *cmd, int mode, ExecResult *res) {
+    Plan plan;
+    int rc = build_plan(cmd, PLAN_AUTO, &plan, res);
+    if (rc == 0) run_stages(plan.stages, plan.nstages, mode, plan.nstages > 1, res);
+    arena_reset(&plan_arena);
+    return res->exit_status;
+}
+
+int exec_spawn(char *cmd, ExecResult *res, const ExecAttr *attr) {
+    Plan plan;
+    ExecJob job;
+    int rc = build_plan(cmd, PLAN_AUTO, &plan, res);
+    if (rc == 0) rc = start_stages(plan.stages, plan.nstages, EXEC_DIRECT, plan.nstages > 1, attr, res, &job);
+    arena_reset(&plan_arena);
+    return rc;
+}
+
+int exec_job_start(const char *cmd, ExecResult *res, ExecJob *job, const ExecAttr *attr) {
+    job->res = res;
+    job->out_fd = job->err_fd = -1;
+    job->pidfds = NULL;
+    job->pending = 0;
+    job->epfd = -1;
+    job->base = res->nstages;
+
+    Plan plan;
+    int rc = 0;
+    PlanCache *pc = attr ? attr->plans : NULL;
+    PlanEntry *hit = pc ? plan_cache_lookup(pc, cmd) : NULL;
+    if (hit) {
+        // Cached plans parsed cleanly: straight to the fork
+        plan = hit->plan;
+        res->validate_err = VALIDATE_SUCCESS;
+        res->parse_err = PARSE_SUCCESS;
+    } else {
+        rc = build_plan(cmd, 1, &plan, res);
+        if (rc == 0 && pc) plan_cache_insert(pc, cmd, &plan);
+    }
+    // The children have their own copies of argv; the parent's can go right away
+    if (rc == 0) rc = start_stages(plan.stages, plan.nstages, EXEC_CAPTURE, 1, attr, res, job);
+    if (hit) plan_cache_release(pc, hit);
+    arena_reset(&plan_arena);
+    return rc;
 }
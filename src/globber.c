@@ -0,0 +1,414 @@
+#define _GNU_SOURCE
+#include "globber.h"
+#include "util.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// A listing read this soon after the directory's last change is not trusted:
+// another change within the same timestamp tick would leave the mtime as it is
+#define MTIME_SLACK_NS 1000000000LL
+
+typedef struct {
+    char *name;
+    unsigned char type;             // DT_* (DT_UNKNOWN resolved with lstat)
+} DirEnt;
+
+// One directory's entries, immutable once built; shared by refcount
+typedef struct DirList {
+    char *path;                     // Absolute path: the key
+    dev_t dev;
+    ino_t ino;
+    long long mtime_ns;
+    int trusted;                    // Old enough to be reused while the mtime matches
+    int nnames;
+    DirEnt *ents;                   // Sorted by name, without . and ..
+    char *blob;                     // Backs the names
+    int refs;                       // The cache's own plus one per user
+    struct DirList *next;           // Bucket chain
+    struct DirList *newer, *older;  // LRU order
+} DirList;
+
+static struct {
+    DirList *buckets[GLOB_CACHE_BUCKETS];
+    DirList *newest, *oldest;
+    int ndirs;
+    long nnames;
+    pthread_mutex_t lock;
+} g_dirs = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static void *xrealloc(void *p, size_t n) {
+    p = realloc(p, n);
+    if (!p) {
+        perror("realloc");
+        _exit(127);
+    }
+    return p;
+}
+
+typedef struct {
+    char **v;
+    int n, cap;
+} StrVec;
+
+static void vec_push(StrVec *s, char *p) {
+    if (s->n == s->cap) {
+        s->cap = s->cap ? s->cap * 2 : 16;
+        s->v = xrealloc(s->v, s->cap * sizeof(char *));
+    }
+    s->v[s->n++] = p;
+}
+
+static void vec_free(StrVec *s) {
+    for (int i = 0; i < s->n; i++) free(s->v[i]);
+    free(s->v);
+    s->v = NULL;
+    s->n = s->cap = 0;
+}
+
+static long long ts_ns(const struct timespec *ts) {
+    return ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+// FNV-1a
+static unsigned bucket_of(const char *path) {
+    unsigned h = 2166136261u;
+    for (const char *p = path; *p; p++) {
+        h ^= (unsigned char)*p;
+        h *= 16777619u;
+    }
+    return h % GLOB_CACHE_BUCKETS;
+}
+
+static void free_list(DirList *d) {
+    free(d->path);
+    free(d->ents);
+    free(d->blob);
+    free(d);
+}
+
+static void release(DirList *d) {
+    pthread_mutex_lock(&g_dirs.lock);
+    int left = --d->refs;
+    pthread_mutex_unlock(&g_dirs.lock);
+    if (left == 0) free_list(d);
+}
+
+// Unlinks d from the table and the LRU order; caller holds the lock
+static void drop(DirList *d) {
+    for (DirList **link = &g_dirs.buckets[bucket_of(d->path)]; *link; link = &(*link)->next) {
+        if (*link == d) {
+            *link = d->next;
+            break;
+        }
+    }
+    if (d->newer) d->newer->older = d->older;
+    else g_dirs.newest = d->older;
+    if (d->older) d->older->newer = d->newer;
+    else g_dirs.oldest = d->newer;
+    g_dirs.ndirs--;
+    g_dirs.nnames -= d->nnames;
+    if (--d->refs == 0) free_list(d);
+}
+
+static int cmp_ent(const void *a, const void *b) {
+    return strcmp(((const DirEnt *)a)->name, ((const DirEnt *)b)->name);
+}
+
+// Reads the directory at path (already stat'ed as st), or returns NULL
+static DirList *read_dir(const char *path, const struct stat *st) {
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    DIR *dir = fdopendir(fd);
+    if (!dir) {
+        close(fd);
+        return NULL;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    DirList *d = xrealloc(NULL, sizeof(*d));
+    memset(d, 0, sizeof(*d));
+    size_t blen = 0, bcap = 0;
+    int cap = 0;
+    struct dirent *de;
+    while ((de = readdir(dir)) != NULL) {
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) continue;
+        size_t len = strlen(de->d_name) + 1;
+        if (d->nnames == cap) {
+            cap = cap ? cap * 2 : 64;
+            d->ents = xrealloc(d->ents, cap * sizeof(DirEnt));
+        }
+        if (blen + len > bcap) {
+            bcap = bcap ? bcap * 2 : 4096;
+            while (bcap < blen + len) bcap *= 2;
+            d->blob = xrealloc(d->blob, bcap);
+        }
+        unsigned char type = de->d_type;
+        struct stat est;
+        if (type == DT_UNKNOWN && fstatat(fd, de->d_name, &est, AT_SYMLINK_NOFOLLOW) == 0) {
+            type = S_ISDIR(est.st_mode) ? DT_DIR : S_ISLNK(est.st_mode) ? DT_LNK : DT_REG;
+        }
+        memcpy(d->blob + blen, de->d_name, len);
+        // An offset for now: the blob may still move
+        d->ents[d->nnames].name = (char *)blen;
+        d->ents[d->nnames++].type = type;
+        blen += len;
+    }
+    closedir(dir);
+
+    for (int i = 0; i < d->nnames; i++) d->ents[i].name = d->blob + (size_t)d->ents[i].name;
+    // Sorted once here, matches within a directory come out in order
+    qsort(d->ents, d->nnames, sizeof(DirEnt), cmp_ent);
+    d->path = xstrdup(path);
+    d->dev = st->st_dev;
+    d->ino = st->st_ino;
+    d->mtime_ns = ts_ns(&st->st_mtim);
+    d->trusted = ts_ns(&now) - d->mtime_ns > MTIME_SLACK_NS;
+    return d;
+}
+
+// Returns the listing of the directory at path (absolute), held for the caller,
+// from the cache while the directory's mtime says it is unchanged
+static DirList *get_dir(const char *path) {
+    struct stat st;
+    if (stat(path, &st) < 0 || !S_ISDIR(st.st_mode)) return NULL;
+    unsigned b = bucket_of(path);
+
+    pthread_mutex_lock(&g_dirs.lock);
+    DirList *d = g_dirs.buckets[b];
+    while (d && strcmp(d->path, path) != 0) d = d->next;
+    if (d && d->trusted && d->dev == st.st_dev && d->ino == st.st_ino && d->mtime_ns == ts_ns(&st.st_mtim)) {
+        d->refs++;
+        if (d != g_dirs.newest) {
+            d->newer->older = d->older;
+            if (d->older) d->older->newer = d->newer;
+            else g_dirs.oldest = d->newer;
+            d->newer = NULL;
+            d->older = g_dirs.newest;
+            g_dirs.newest->newer = d;
+            g_dirs.newest = d;
+        }
+        pthread_mutex_unlock(&g_dirs.lock);
+        return d;
+    }
+    pthread_mutex_unlock(&g_dirs.lock);
+
+    d = read_dir(path, &st);
+    if (!d) return NULL;
+    d->refs = 2;  // The cache's and the caller's
+
+    pthread_mutex_lock(&g_dirs.lock);
+    // Replace what is there: stale, or a concurrent read of the same directory
+    for (DirList *o = g_dirs.buckets[b]; o; o = o->next) {
+        if (strcmp(o->path, path) == 0) {
+            drop(o);
+            break;
+        }
+    }
+    while (g_dirs.oldest && (g_dirs.ndirs >= GLOB_CACHE_MAX_DIRS || g_dirs.nnames + d->nnames > GLOB_CACHE_MAX_NAMES)) {
+        drop(g_dirs.oldest);
+    }
+    d->next = g_dirs.buckets[b];
+    g_dirs.buckets[b] = d;
+    d->older = g_dirs.newest;
+    if (g_dirs.newest) g_dirs.newest->newer = d;
+    else g_dirs.oldest = d;
+    g_dirs.newest = d;
+    g_dirs.ndirs++;
+    g_dirs.nnames += d->nnames;
+    pthread_mutex_unlock(&g_dirs.lock);
+    return d;
+}
+
+// Path of name under base as the user would write it ("" is the cwd)
+static char *join(const char *base, const char *name) {
+    size_t bl = strlen(base), nl = strlen(name);
+    int sep = bl > 0 && base[bl - 1] != '/';
+    char *p = xrealloc(NULL, bl + sep + nl + 1);
+    memcpy(p, base, bl);
+    if (sep) p[bl] = '/';
+    memcpy(p + bl + sep, name, nl + 1);
+    return p;
+}
+
+// Absolute form of a path built by join(), for cache keys and stat()
+static void absolute(char *buf, size_t size, const char *cwd, const char *path) {
+    if (path[0] == '/') snprintf(buf, size, "%s", path);
+    else if (!*path) snprintf(buf, size, "%s", cwd);
+    else snprintf(buf, size, "%s/%s", cwd, path);
+}
+
+static int has_magic(const char *s) {
+    return strpbrk(s, "*?[") != NULL;
+}
+
+// State of one ** walk, shared by its threads
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    StrVec queue;       // Directories waiting to be listed
+    StrVec dirs;        // Every directory reached, the starting ones included
+    StrVec entries;     // With want_entries: every visible entry below them
+    int active;         // Threads listing a directory right now
+    int want_entries;
+    const char *cwd;
+} Walk;
+
+static void *walk_worker(void *arg) {
+    Walk *w = arg;
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        while (w->queue.n == 0 && w->active > 0) pthread_cond_wait(&w->cond, &w->lock);
+        if (w->queue.n == 0) break;
+        char *base = w->queue.v[--w->queue.n];
+        w->active++;
+        pthread_mutex_unlock(&w->lock);
+
+        char abs[PATH_MAX];
+        absolute(abs, sizeof(abs), w->cwd, base);
+        StrVec subdirs = { 0 }, found = { 0 };
+        DirList *d = get_dir(abs);
+        for (int i = 0; d && i < d->nnames; i++) {
+            // Like a leading-dot name for *, hidden entries are not walked into
+            if (d->ents[i].name[0] == '.') continue;
+            if (d->ents[i].type == DT_DIR) vec_push(&subdirs, join(base, d->ents[i].name));
+            if (w->want_entries) vec_push(&found, join(base, d->ents[i].name));
+        }
+        if (d) release(d);
+
+        pthread_mutex_lock(&w->lock);
+        for (int i = 0; i < subdirs.n; i++) {
+            vec_push(&w->queue, xstrdup(subdirs.v[i]));
+            vec_push(&w->dirs, subdirs.v[i]);
+        }
+        for (int i = 0; i < found.n; i++) vec_push(&w->entries, found.v[i]);
+        free(subdirs.v);
+        free(found.v);
+        free(base);
+        w->active--;
+        pthread_cond_broadcast(&w->cond);
+    }
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+// Expands ** over bases: *out gets every directory at any depth below them (the
+// bases included) or, with want_entries, every visible entry below them
+static void walk(const char *cwd, StrVec *bases, int want_entries, StrVec *out) {
+    Walk w = { .want_entries = want_entries, .cwd = cwd };
+    pthread_mutex_init(&w.lock, NULL);
+    pthread_cond_init(&w.cond, NULL);
+    for (int i = 0; i < bases->n; i++) {
+        vec_push(&w.queue, xstrdup(bases->v[i]));
+        vec_push(&w.dirs, xstrdup(bases->v[i]));
+    }
+
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    int nthreads = ncpu < 1 ? 1 : ncpu > GLOB_WALK_THREADS ? GLOB_WALK_THREADS : (int)ncpu;
+    pthread_t tids[GLOB_WALK_THREADS];
+    int started = 0;
+    // This thread works too
+    while (started < nthreads - 1 && pthread_create(&tids[started], NULL, walk_worker, &w) == 0) started++;
+    walk_worker(&w);
+    for (int i = 0; i < started; i++) pthread_join(tids[i], NULL);
+
+    free(w.queue.v);
+    if (want_entries) {
+        vec_free(&w.dirs);
+        *out = w.entries;
+    } else {
+        *out = w.dirs;
+    }
+    pthread_cond_destroy(&w.cond);
+    pthread_mutex_destroy(&w.lock);
+}
+
+// Drops the backslashes of a component without glob characters
+static void unescape(char *s) {
+    char *o = s;
+    for (; *s; s++) {
+        if (*s == '\\' && s[1]) s++;
+        *o++ = *s;
+    }
+    *o = '\0';
+}
+
+static int cmp_str(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+int glob_expand(Arena *a, const char *pattern, char ***out) {
+    *out = NULL;
+    char cwd[PATH_MAX] = "";
+    if (pattern[0] != '/' && !getcwd(cwd, sizeof(cwd))) return 0;
+
+    // Components after the leading slashes, which become the root of every path
+    char *pat = xstrdup(pattern);
+    char *rest = pat + strspn(pat, "/");
+    char root[PATH_MAX];
+    snprintf(root, sizeof(root), "%.*s", (int)(rest - pat), pat);
+
+    StrVec bases = { 0 }, results = { 0 };
+    vec_push(&bases, xstrdup(root));
+    char *comp = rest;
+    for (int last = 0; !last && bases.n > 0; ) {
+        char *slash = strchr(comp, '/');
+        if (slash) *slash = '\0';
+        last = !slash;
+        StrVec next = { 0 };
+
+        if (strcmp(comp, "**") == 0) {
+            walk(cwd, &bases, last, last ? &results : &next);
+        } else if (has_magic(comp)) {
+            for (int i = 0; i < bases.n; i++) {
+                char abs[PATH_MAX];
+                absolute(abs, sizeof(abs), cwd, bases.v[i]);
+                DirList *d = get_dir(abs);
+                for (int j = 0; d && j < d->nnames; j++) {
+                    if (fnmatch(comp, d->ents[j].name, FNM_PERIOD) != 0) continue;
+                    // Only something that may be a directory can lead anywhere
+                    if (!last && d->ents[j].type != DT_DIR && d->ents[j].type != DT_LNK) continue;
+                    vec_push(last ? &results : &next, join(bases.v[i], d->ents[j].name));
+                }
+                if (d) release(d);
+            }
+        } else {
+            unescape(comp);
+            for (int i = 0; i < bases.n; i++) {
+                char *p = join(bases.v[i], comp);
+                char abs[PATH_MAX];
+                struct stat st;
+                absolute(abs, sizeof(abs), cwd, p);
+                // Intermediate names are checked when their directory is listed;
+                // "" is the cwd itself, reached through a trailing **/
+                if (*p && (!last || lstat(abs, &st) == 0)) vec_push(last ? &results : &next, p);
+                else free(p);
+            }
+        }
+        vec_free(&bases);
+        bases = next;
+        if (slash) comp = slash + 1;
+    }
+    vec_free(&bases);
+    free(pat);
+
+    int sorted = 1;
+    for (int i = 1; sorted && i < results.n; i++) sorted = strcmp(results.v[i - 1], results.v[i]) <= 0;
+    if (!sorted) qsort(results.v, results.n, sizeof(char *), cmp_str);
+    char **v = arena_alloc(a, (results.n ? results.n : 1) * sizeof(char *));
+    for (int i = 0; i < results.n; i++) v[i] = arena_strdup(a, results.v[i]);
+    int n = results.n;
+    vec_free(&results);
+    *out = v;
+    return n;
+}
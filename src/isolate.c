@@ -0,0 +1,149 @@
+#define _GNU_SOURCE
+#include "isolate.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+int isolate_parse_cpulist(const char *list, cpu_set_t *set) {
+    CPU_ZERO(set);
+    const char *p = list;
+    while (*p) {
+        char *end;
+        long lo = strtol(p, &end, 10);
+        if (end == p || lo < 0) return -1;
+        long hi = lo;
+        if (*end == '-') {
+            p = end + 1;
+            hi = strtol(p, &end, 10);
+            if (end == p || hi < lo) return -1;
+        }
+        if (hi >= CPU_SETSIZE) return -1;
+        for (long c = lo; c <= hi; c++) CPU_SET(c, set);
+        if (*end == ',') end++;
+        else if (*end) return -1;
+        p = end;
+    }
+    return CPU_COUNT(set) > 0 ? 0 : -1;
+}
+
+int isolate_enabled(const IsolateConfig *cfg) {
+    return cfg->cpu_max || cfg->memory_max > 0 || cfg->pids_max > 0 || cfg->pin_shell;
+}
+
+// Writes value into dir/file; returns 0 or -1 (errno set)
+static int write_cgroup_file(const char *dir, const char *file, const char *value) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", dir, file);
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    ssize_t n = write(fd, value, strlen(value));
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return n < 0 ? -1 : 0;
+}
+
+int isolate_init(IsolateConfig *cfg) {
+    cfg->use_cgroups = 0;
+
+    if (cfg->pin_server && sched_setaffinity(0, sizeof(cfg->server_cpus), &cfg->server_cpus) < 0) {
+        perror("sched_setaffinity");
+    }
+
+    if (!cfg->cgroup_root) {
+        if (cfg->pids_max > 0) fprintf(stderr, "[WARN] -p task limit needs a cgroup v2 root (-g); not enforced\n");
+        return 0;
+    }
+
+    // A cgroup with controllers enabled for its children may not hold processes
+    // itself, so the server first moves into a leaf of its own
+    char server_leaf[PATH_MAX];
+    snprintf(server_leaf, sizeof(server_leaf), "%s/server", cfg->cgroup_root);
+    char pid[32];
+    snprintf(pid, sizeof(pid), "%d", (int)getpid());
+    if ((mkdir(server_leaf, 0755) < 0 && errno != EEXIST) ||
+        write_cgroup_file(server_leaf, "cgroup.procs", pid) < 0) {
+        fprintf(stderr, "[WARN] cgroup root %s not delegated (%s); using rlimit fallback%s\n",
+                cfg->cgroup_root, strerror(errno), cfg->pids_max > 0 ? " (task limit not enforced)" : "");
+        return -1;
+    }
+
+    // Enable what we need; missing controllers just mean that limit is not applied
+    const char *controllers[] = { "+cpu", "+memory", "+pids" };
+    for (size_t i = 0; i < sizeof(controllers) / sizeof(controllers[0]); i++) {
+        if (write_cgroup_file(cfg->cgroup_root, "cgroup.subtree_control", controllers[i]) < 0) {
+            fprintf(stderr, "[WARN] cannot enable %s controller in %s: %s\n",
+                    controllers[i] + 1, cfg->cgroup_root, strerror(errno));
+        }
+    }
+    cfg->use_cgroups = 1;
+    return 0;
+}
+
+void isolate_job_begin(const IsolateConfig *cfg, int job_id, JobIsolation *ji) {
+    ji->cfg = cfg;
+    ji->leaf[0] = '\0';
+    ji->procs_fd = -1;
+    ji->need_fallback = 1;
+    if (!cfg->use_cgroups) return;
+
+    snprintf(ji->leaf, sizeof(ji->leaf), "%s/job-%d", cfg->cgroup_root, job_id);
+    if (mkdir(ji->leaf, 0755) < 0 && errno != EEXIST) {
+        perror("mkdir cgroup leaf");
+        ji->leaf[0] = '\0';
+        return;
+    }
+    ji->need_fallback = 0;
+
+    // A limit whose controller is not available is enforced by the fallback instead
+    char value[64];
+    if (cfg->cpu_max && write_cgroup_file(ji->leaf, "cpu.max", cfg->cpu_max) < 0) ji->need_fallback = 1;
+    if (cfg->memory_max > 0) {
+        snprintf(value, sizeof(value), "%lld", cfg->memory_max);
+        if (write_cgroup_file(ji->leaf, "memory.max", value) < 0) ji->need_fallback = 1;
+    }
+    if (cfg->pids_max > 0) {
+        snprintf(value, sizeof(value), "%ld", cfg->pids_max);
+        if (write_cgroup_file(ji->leaf, "pids.max", value) < 0) ji->need_fallback = 1;
+    }
+
+    // Opened here so the children only need an async-signal-safe write()
+    char path[PATH_MAX + 16];
+    snprintf(path, sizeof(path), "%s/cgroup.procs", ji->leaf);
+    ji->procs_fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (ji->procs_fd < 0) {
+        perror("open cgroup.procs");
+        rmdir(ji->leaf);
+        ji->leaf[0] = '\0';
+        ji->need_fallback = 1;
+    }
+}
+
+void isolate_child(void *arg) {
+    JobIsolation *ji = arg;
+    const IsolateConfig *cfg = ji->cfg;
+
+    int joined = ji->procs_fd >= 0 && write(ji->procs_fd, "0", 1) == 1;
+    if (!joined || ji->need_fallback) {
+        // Not delegated: per-process rlimits and a lower priority instead of cpu.max
+        if (cfg->memory_max > 0) {
+            struct rlimit rl = { cfg->memory_max, cfg->memory_max };
+            setrlimit(RLIMIT_AS, &rl);
+        }
+        // No pids fallback: RLIMIT_NPROC counts every process of the user, not the job's
+        if (cfg->cpu_max) setpriority(PRIO_PROCESS, 0, 10);
+    }
+    if (cfg->pin_shell) sched_setaffinity(0, sizeof(cfg->shell_cpus), &cfg->shell_cpus);
+}
+
+void isolate_job_end(JobIsolation *ji) {
+    if (ji->procs_fd >= 0) close(ji->procs_fd);
+    ji->procs_fd = -1;
+    if (ji->leaf[0] && rmdir(ji->leaf) < 0) perror("rmdir cgroup leaf");
+    ji->leaf[0] = '\0';
+}
@@ -0,0 +1,286 @@
+#include "jobctl.h"
+#include "errors.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <termios.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+static ShellJob jobs[JC_MAX_JOBS];
+static int interactive = 0;              // Commands come from a terminal we control
+static pid_t shell_pgid;
+static struct termios shell_tmodes;      // Restored whenever the shell gets the terminal back
+static struct termios job_tmodes[JC_MAX_JOBS];  // Saved when a job is stopped (e.g. an editor)
+static volatile sig_atomic_t child_changed = 0;
+
+static void on_sigchld(int sig) {
+    (void)sig;
+    child_changed = 1;
+}
+
+void jc_init(int is_interactive) {
+    // Reaping happens at safe points (jc_notify), never in the handler, so
+    // synchronous waits elsewhere in the shell keep their children
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_sigchld;
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGCHLD, &sa, NULL);
+
+    interactive = is_interactive;
+    if (!interactive) return;
+
+    // Started in the background: wait until we are put in the foreground
+    while (tcgetpgrp(STDIN_FILENO) != (shell_pgid = getpgrp())) kill(-shell_pgid, SIGTTIN);
+
+    signal(SIGINT, SIG_IGN);
+    signal(SIGQUIT, SIG_IGN);
+    signal(SIGTSTP, SIG_IGN);
+    signal(SIGTTIN, SIG_IGN);
+    signal(SIGTTOU, SIG_IGN);
+
+    shell_pgid = getpid();
+    if (setpgid(shell_pgid, shell_pgid) < 0 && errno != EPERM) {
+        perror("setpgid");  // EPERM: already a session leader, which is fine
+    }
+    shell_pgid = getpgrp();
+    tcsetpgrp(STDIN_FILENO, shell_pgid);
+    tcgetattr(STDIN_FILENO, &shell_tmodes);
+}
+
+static ShellJob *new_job(const char *cmd) {
+    for (int i = 0; i < JC_MAX_JOBS; i++) {
+        if (jobs[i].id) continue;
+        jobs[i].id = i + 1;
+        jobs[i].cmd = xstrdup(cmd);
+        jobs[i].pgid = -1;
+        jobs[i].shared_pgrp = 0;
+        jobs[i].alive = 0;
+        jobs[i].state = JC_RUNNING;
+        exec_result_init(&jobs[i].res, 0);
+        return &jobs[i];
+    }
+    return NULL;
+}
+
+static void free_job(ShellJob *j) {
+    free(j->cmd);
+    exec_result_free(&j->res);
+    j->cmd = NULL;
+    j->id = 0;
+}
+
+// Collects state changes of j's stages. With block set, waits until the job has
+// exited or stopped; otherwise only takes what is already there. A job sharing
+// the shell's group is not under job control and is waited for until it exits.
+static void update_job(ShellJob *j, int block) {
+    int flags = (j->shared_pgrp ? 0 : WUNTRACED | WCONTINUED) | (block ? 0 : WNOHANG);
+    while (j->alive > 0) {
+        int status;
+        struct rusage ru;
+        pid_t pid = wait4(-j->pgid, &status, flags, &ru);
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            j->alive = 0;  // ECHILD: nothing left in the group
+            break;
+        }
+        if (pid == 0) break;
+
+        if (WIFSTOPPED(status)) {
+            j->state = JC_STOPPED;
+            if (block) break;
+            continue;
+        }
+        if (WIFCONTINUED(status)) {
+            j->state = JC_RUNNING;
+            continue;
+        }
+        for (int i = 0; i < j->res.nstages; i++) {
+            if (j->res.stages[i].pid == pid) exec_record_exit(&j->res.stages[i], status, &ru);
+        }
+        j->alive--;
+    }
+    if (j->alive == 0) {
+        j->state = JC_DONE;
+        // Exit status of a pipeline is the status of its last stage
+        j->res.exit_status = j->res.stages[j->res.nstages - 1].status;
+    }
+}
+
+// Gives j the terminal, waits for it to exit or stop, and takes the terminal back.
+// Returns the job's status (128+SIGTSTP if it was stopped).
+static int wait_foreground(ShellJob *j) {
+    if (interactive) tcsetpgrp(STDIN_FILENO, j->pgid);
+    update_job(j, 1);
+    if (interactive) {
+        tcsetpgrp(STDIN_FILENO, shell_pgid);
+        if (j->state == JC_STOPPED) tcgetattr(STDIN_FILENO, &job_tmodes[j->id - 1]);
+        tcsetattr(STDIN_FILENO, TCSADRAIN, &shell_tmodes);
+    }
+
+    if (j->state == JC_STOPPED) {
+        printf("\n[%d]+  Stopped                 %s\n", j->id, j->cmd);
+        return 128 + SIGTSTP;
+    }
+    int status = j->res.exit_status;
+    free_job(j);
+    return status;
+}
+
+int jc_run(char *cmd, int background) {
+    if (strspn(cmd, " \t") == strlen(cmd)) {
+        fputs(ERR_CMD_MISSING_BEFORE_BG, stderr);
+        return 2;
+    }
+    ShellJob *j = new_job(cmd);
+    if (!j) {
+        fprintf(stderr, "Too many jobs (max %d)\n", JC_MAX_JOBS);
+        return 1;
+    }
+
+    // Without a terminal to hand over, a foreground job in a group of its own would
+    // be stopped by SIGTTIN on reading it and miss Ctrl-C
+    int own_group = background || interactive;
+    ExecAttr attr = { .stdin_fd = -1, .pgrp = own_group, .foreground = !background && interactive };
+    if (exec_spawn(cmd, &j->res, &attr) < 0) {
+        // Syntax error (message already in res.err) or nothing could be started
+        char *msg = capture_to_string(&j->res.err);
+        fputs(msg, stderr);
+        free(msg);
+        int status = j->res.exit_status < 0 ? 1 : j->res.exit_status;
+        free_job(j);
+        return status;
+    }
+    j->pgid = own_group ? j->res.stages[0].pid : getpgrp();
+    j->shared_pgrp = !own_group;
+    for (int i = 0; i < j->res.nstages; i++) {
+        if (j->res.stages[i].pid > 0) j->alive++;
+    }
+
+    if (background) {
+        if (interactive) printf("[%d] %d\n", j->id, (int)j->pgid);
+        return 0;
+    }
+    return wait_foreground(j);
+}
+
+// Resolves "%N"/"N" (or the most recent job when arg is empty, preferring a
+// stopped one if want_stopped is set)
+static ShellJob *find_job(const char *arg, int want_stopped) {
+    if (*arg) {
+        if (*arg == '%') arg++;
+        int id = atoi(arg);
+        if (id < 1 || id > JC_MAX_JOBS || jobs[id - 1].id == 0) return NULL;
+        return &jobs[id - 1];
+    }
+    ShellJob *best = NULL;
+    for (int i = JC_MAX_JOBS - 1; i >= 0; i--) {
+        if (!jobs[i].id) continue;
+        if (!want_stopped || jobs[i].state == JC_STOPPED) return &jobs[i];
+        if (!best) best = &jobs[i];
+    }
+    return best;
+}
+
+static void resume(ShellJob *j) {
+    if (j->state == JC_STOPPED && interactive) {
+        tcsetattr(STDIN_FILENO, TCSADRAIN, &job_tmodes[j->id - 1]);
+    }
+    j->state = JC_RUNNING;
+    if (kill(-j->pgid, SIGCONT) < 0) perror("kill (SIGCONT)");
+}
+
+static void list_jobs(void) {
+    ShellJob *current = find_job("", 0);
+    for (int i = 0; i < JC_MAX_JOBS; i++) {
+        if (!jobs[i].id) continue;
+        printf("[%d]%c  %-24s%s\n", jobs[i].id, &jobs[i] == current ? '+' : ' ',
+               jobs[i].state == JC_STOPPED ? "Stopped" : "Running", jobs[i].cmd);
+    }
+}
+
+// Blocks until j exits (or stops); returns its status
+static int wait_job(ShellJob *j) {
+    while (j->state != JC_DONE) {
+        update_job(j, 1);
+        if (j->state == JC_STOPPED) return 128 + SIGTSTP;
+    }
+    int status = j->res.exit_status;
+    free_job(j);
+    return status;
+}
+
+int jc_builtin(const char *cmd, int *status) {
+    char name[8], arg[32] = "";
+    if (sscanf(cmd, " %7s %31s", name, arg) < 1) return 0;
+    int is_fg = strcmp(name, "fg") == 0, is_bg = strcmp(name, "bg") == 0;
+    if (!is_fg && !is_bg && strcmp(name, "jobs") != 0 && strcmp(name, "wait") != 0) return 0;
+
+    jc_notify();
+    *status = 0;
+    if (name[0] == 'j') {
+        list_jobs();
+        return 1;
+    }
+    if (name[0] == 'w' && !*arg) {
+        // Plain `wait`: every running background job
+        for (int i = 0; i < JC_MAX_JOBS; i++) {
+            if (jobs[i].id && jobs[i].state == JC_RUNNING) wait_job(&jobs[i]);
+        }
+        return 1;
+    }
+
+    ShellJob *j = find_job(arg, is_bg);
+    if (!j) {
+        fprintf(stderr, "%s: %s", name, ERR_NO_SUCH_JOB);
+        *status = 1;
+        return 1;
+    }
+    if (is_fg) {
+        printf("%s\n", j->cmd);
+        fflush(stdout);
+        resume(j);
+        *status = wait_foreground(j);
+    } else if (is_bg) {
+        resume(j);
+        printf("[%d]+ %s &\n", j->id, j->cmd);
+    } else {
+        *status = wait_job(j);
+    }
+    return 1;
+}
+
+void jc_notify(void) {
+    if (!child_changed) return;
+    child_changed = 0;
+    for (int i = 0; i < JC_MAX_JOBS; i++) {
+        ShellJob *j = &jobs[i];
+        if (!j->id) continue;
+        JcState before = j->state;
+        update_job(j, 0);
+        if (j->state == JC_DONE && !interactive) {
+            free_job(j);
+        } else if (j->state == JC_DONE) {
+            if (j->res.exit_status == 0) printf("[%d]+  Done                    %s\n", j->id, j->cmd);
+            else printf("[%d]+  Exit %-19d%s\n", j->id, j->res.exit_status, j->cmd);
+            free_job(j);
+        } else if (j->state == JC_STOPPED && before != JC_STOPPED) {
+            printf("[%d]+  Stopped                 %s\n", j->id, j->cmd);
+        }
+    }
+    fflush(stdout);
+}
+
+void jc_shutdown(void) {
+    for (int i = 0; i < JC_MAX_JOBS; i++) {
+        if (jobs[i].id && jobs[i].state == JC_STOPPED) {
+            kill(-jobs[i].pgid, SIGHUP);
+            kill(-jobs[i].pgid, SIGCONT);
+        }
+    }
+}
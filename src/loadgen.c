@@ -0,0 +1,296 @@
+#define _GNU_SOURCE
+#include "net.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <math.h>
+#include <time.h>
+
+// Load generator for the server: N connections, each with its own thread, send
+// a weighted mix of commands either at a fixed total arrival rate (open loop,
+// -r) or back to back with think time (closed loop). Every command's latency is
+// taken to its first frame (TTFB) and to its <<EOF>>. In open loop both are
+// measured from the time the command was due, not when it could be sent, so a
+// server that falls behind shows up as latency instead of fewer samples.
+
+#define LOADGEN_MAX_MIX 32
+
+typedef struct {
+    char *cmd;
+    int weight;
+} MixEntry;
+
+// Latencies (ms) of one connection's completed commands, per mix entry
+typedef struct {
+    double *ttfb, *eof;
+    int n, cap;
+} Samples;
+
+typedef struct {
+    int id;
+    pthread_t tid;
+    unsigned long long rng;
+    Samples per_mix[LOADGEN_MAX_MIX];
+    long sent, failed;
+} Conn;
+
+static const char *g_host = "127.0.0.1";
+static int g_port = 8080;
+static MixEntry g_mix[LOADGEN_MAX_MIX];
+static int g_nmix, g_total_weight;
+static int g_conns = 8;
+static double g_rate = 0;           // Commands/s over all connections; 0 = closed loop
+static int g_poisson = 0;           // Open loop: exponential instead of fixed inter-arrival gaps
+static double g_think_ms = 0;       // Closed loop: pause between a reply and the next command
+static double g_duration_s = 10, g_warmup_s = 1;
+static double g_start, g_measure_from, g_end;   // CLOCK_MONOTONIC ms
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void sleep_until(double t) {
+    double left = t - now_ms();
+    if (left <= 0) return;
+    struct timespec ts = { (time_t)(left / 1e3), (long)(fmod(left, 1e3) * 1e6) };
+    nanosleep(&ts, NULL);
+}
+
+// splitmix64, seeded per connection so runs are reproducible
+static double rng_uniform(unsigned long long *s) {
+    unsigned long long z = (*s += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    return (z >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static int pick_mix(unsigned long long *s) {
+    int r = (int)(rng_uniform(s) * g_total_weight);
+    for (int i = 0; i < g_nmix; i++) {
+        if (r < g_mix[i].weight) return i;
+        r -= g_mix[i].weight;
+    }
+    return g_nmix - 1;
+}
+
+static void add_sample(Samples *s, double ttfb, double eof) {
+    if (s->n == s->cap) {
+        s->cap = s->cap ? s->cap * 2 : 256;
+        s->ttfb = realloc(s->ttfb, s->cap * sizeof(double));
+        s->eof = realloc(s->eof, s->cap * sizeof(double));
+        if (!s->ttfb || !s->eof) {
+            perror("realloc");
+            _exit(127);
+        }
+    }
+    s->ttfb[s->n] = ttfb;
+    s->eof[s->n] = eof;
+    s->n++;
+}
+
+// Sends cmd and reads frames up to <<EOF>>. Returns 0 with the times of the
+// first frame and of <<EOF>>, or -1 if the connection failed.
+static int run_command(int fd, const char *cmd, char **buf, size_t *size, double *first, double *eof) {
+    if (send_line(fd, cmd) < 0) return -1;
+    *first = 0;
+    while (1) {
+        int type;
+        int n = receive_frame_alloc(fd, &type, buf, size);
+        if (n < 0) return -1;
+        if (*first == 0) *first = now_ms();
+        if (type == FRAME_LINE && strcmp(*buf, "<<EOF>>") == 0) {
+            *eof = now_ms();
+            return 0;
+        }
+    }
+}
+
+static void *conn_loop(void *arg) {
+    Conn *c = arg;
+    int fd = create_client_socket(g_host, g_port);
+    if (fd < 0) {
+        c->failed++;
+        return NULL;
+    }
+    char *buf = NULL;
+    size_t size = 0;
+
+    // Open loop: this connection's share of the rate, phase-shifted so the
+    // connections do not all fire together
+    double gap = g_rate > 0 ? g_conns * 1e3 / g_rate : 0;
+    double due = g_start + gap * c->id / g_conns;
+
+    while (1) {
+        if (gap > 0) {
+            sleep_until(due);
+        }
+        double t0 = gap > 0 ? due : now_ms();
+        if (t0 >= g_end) break;
+
+        int m = pick_mix(&c->rng);
+        double first, eof;
+        c->sent++;
+        if (run_command(fd, g_mix[m].cmd, &buf, &size, &first, &eof) < 0) {
+            c->failed++;
+            break;
+        }
+        if (t0 >= g_measure_from) add_sample(&c->per_mix[m], first - t0, eof - t0);
+
+        if (gap > 0) {
+            due += g_poisson ? -gap * log(1 - rng_uniform(&c->rng)) : gap;
+        } else if (g_think_ms > 0) {
+            sleep_until(now_ms() + g_think_ms);
+        }
+    }
+    send_line(fd, "exit");
+    close_socket(fd);
+    free(buf);
+    return NULL;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Nearest-rank percentile of sorted v
+static double percentile(const double *v, int n, double p) {
+    if (n == 0) return 0;
+    int i = (int)(p / 100 * n + 0.999999) - 1;
+    if (i < 0) i = 0;
+    if (i >= n) i = n - 1;
+    return v[i];
+}
+
+// Prints one result line for the samples of mix entry m (all entries if m < 0)
+static void report(Conn *conns, int m, const char *label, double secs) {
+    int n = 0;
+    for (int i = 0; i < g_conns; i++) {
+        for (int j = 0; j < g_nmix; j++) {
+            if (m < 0 || j == m) n += conns[i].per_mix[j].n;
+        }
+    }
+    double *ttfb = malloc((n + 1) * sizeof(double)), *eof = malloc((n + 1) * sizeof(double));
+    if (!ttfb || !eof) {
+        perror("malloc");
+        _exit(127);
+    }
+    int k = 0;
+    for (int i = 0; i < g_conns; i++) {
+        for (int j = 0; j < g_nmix; j++) {
+            if (m >= 0 && j != m) continue;
+            Samples *s = &conns[i].per_mix[j];
+            memcpy(ttfb + k, s->ttfb, s->n * sizeof(double));
+            memcpy(eof + k, s->eof, s->n * sizeof(double));
+            k += s->n;
+        }
+    }
+    qsort(ttfb, n, sizeof(double), cmp_double);
+    qsort(eof, n, sizeof(double), cmp_double);
+    printf("loadgen class=\"%s\" completed=%d throughput=%.2f"
+           " ttfb_p50_ms=%.3f ttfb_p99_ms=%.3f ttfb_p999_ms=%.3f ttfb_max_ms=%.3f"
+           " eof_p50_ms=%.3f eof_p99_ms=%.3f eof_p999_ms=%.3f eof_max_ms=%.3f\n",
+           label, n, secs > 0 ? n / secs : 0,
+           percentile(ttfb, n, 50), percentile(ttfb, n, 99), percentile(ttfb, n, 99.9), n ? ttfb[n - 1] : 0,
+           percentile(eof, n, 50), percentile(eof, n, 99), percentile(eof, n, 99.9), n ? eof[n - 1] : 0);
+    free(ttfb);
+    free(eof);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-H host] [-p port] [-c connections] [-d seconds] [-w warmup_s]\n"
+            "       [-r rate [-P] | -t think_ms] [-s seed] [-x weight:command]...\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    unsigned long long seed = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "H:p:c:d:w:r:Pt:s:x:")) != -1) {
+        switch (opt) {
+            case 'H': g_host = optarg; break;
+            case 'p': g_port = atoi(optarg); break;
+            case 'c': g_conns = atoi(optarg); break;
+            case 'd': g_duration_s = atof(optarg); break;
+            case 'w': g_warmup_s = atof(optarg); break;
+            case 'r': g_rate = atof(optarg); break;
+            case 'P': g_poisson = 1; break;
+            case 't': g_think_ms = atof(optarg); break;
+            case 's': seed = strtoull(optarg, NULL, 10); break;
+            case 'x': {
+                // weight:command, e.g. 9:"echo hi" or 1:"demo 2"
+                char *colon = strchr(optarg, ':');
+                if (!colon || g_nmix == LOADGEN_MAX_MIX || atoi(optarg) <= 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                g_mix[g_nmix].weight = atoi(optarg);
+                g_mix[g_nmix].cmd = colon + 1;
+                g_nmix++;
+                break;
+            }
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (g_conns < 1 || g_duration_s <= 0 || g_warmup_s < 0 || g_warmup_s >= g_duration_s || g_rate < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (g_nmix == 0) {
+        // Mostly short shell commands with the odd demo job, which queue behind each other
+        g_mix[g_nmix++] = (MixEntry){ "echo hello", 9 };
+        g_mix[g_nmix++] = (MixEntry){ "demo 1", 1 };
+    }
+    for (int i = 0; i < g_nmix; i++) g_total_weight += g_mix[i].weight;
+    signal(SIGPIPE, SIG_IGN);
+
+    Conn *conns = calloc(g_conns, sizeof(Conn));
+    if (!conns) {
+        perror("calloc");
+        return 1;
+    }
+    g_start = now_ms() + 100;   // Lets every connection get set up first
+    g_measure_from = g_start + g_warmup_s * 1e3;
+    g_end = g_start + g_duration_s * 1e3;
+    for (int i = 0; i < g_conns; i++) {
+        conns[i].id = i;
+        conns[i].rng = seed * 1000003ULL + i;
+        if (pthread_create(&conns[i].tid, NULL, conn_loop, &conns[i]) != 0) {
+            perror("pthread_create");
+            return 1;
+        }
+    }
+    long sent = 0, failed = 0;
+    for (int i = 0; i < g_conns; i++) {
+        pthread_join(conns[i].tid, NULL);
+        sent += conns[i].sent;
+        failed += conns[i].failed;
+    }
+    double wall_s = (now_ms() - g_start) / 1e3;
+
+    fflush(stdout);
+    printf("loadgen mode=%s connections=%d rate=%.2f think_ms=%.1f duration_s=%.1f warmup_s=%.1f wall_s=%.2f sent=%ld failed=%ld\n",
+           g_rate > 0 ? (g_poisson ? "open-poisson" : "open") : "closed", g_conns, g_rate, g_think_ms,
+           g_duration_s, g_warmup_s, wall_s, sent, failed);
+    // Throughput over the measured window: commands that started in it
+    double secs = g_duration_s - g_warmup_s;
+    report(conns, -1, "total", secs);
+    for (int m = 0; m < g_nmix; m++) report(conns, m, g_mix[m].cmd, secs);
+
+    for (int i = 0; i < g_conns; i++) {
+        for (int m = 0; m < g_nmix; m++) {
+            free(conns[i].per_mix[m].ttfb);
+            free(conns[i].per_mix[m].eof);
+        }
+    }
+    free(conns);
+    return failed > 0;
+}
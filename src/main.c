@@ -1,61 +1,216 @@
 #include "parse.h"
 #include "exec.h"
 #include "errors.h"
+#include "capture.h"
+#include "jobctl.h"
+#include "parallel.h"
+#include "util.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#define MAX_CMD_LENGTH 1024 
-#define MAX_ARGS 64
-
-//maximum length for command input buffer
-#define MAX_CMD_LENGTH 1024 
-//maximum number of arguments a command can have
-#define MAX_ARGS 64
-
-// Helper function to check if output is an error message
-static int is_error_message(const char *output) {
-    if(!output) return 0;
-    // Check exact matches first
-    if (strcmp(output, ERR_CMD_MISSING_BEFORE_PIPE) == 0 ||
-        strcmp(output, ERR_CMD_MISSING_AFTER_PIPE) == 0 ||
-        strcmp(output, ERR_EMPTY_CMD_BETWEEN_PIPES) == 0 ||
-        strcmp(output, ERR_INPUT_NOT_SPECIFIED) == 0 ||
-        strcmp(output, ERR_OUTPUT_NOT_SPECIFIED) == 0 ||
-        strcmp(output, ERR_OUTPUT_NOT_SPECIFIED_AFTER) == 0 ||
-        strcmp(output, ERR_ERROR_NOT_SPECIFIED) == 0 ||
-        strcmp(output, ERR_UNCLOSED_QUOTES) == 0 ||
-        strcmp(output, ERR_FILE_NOT_FOUND) == 0) {
+#include <getopt.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//runs one pipeline of a list (background if it was ended by &); returns 1 if it was `exit`
+static int run_command(char *cmd, int direct, int background, int *last_status){
+    //handle exit command: `exit` keeps the last status, `exit N` sets it
+    if(strncmp(cmd, "exit", 4) == 0 && (cmd[4] == '\0' || cmd[4] == ' ')){
+        if(cmd[4] == ' ') *last_status = atoi(cmd + 5);
         return 1;
     }
-    // Check for messages that include command name
-    if (strstr(output, "Command not found:") != NULL ||
-        strstr(output, "Command not found in pipe sequence:") != NULL ||
-        strncmp(output, ERR_CMD_NOT_FOUND, strlen(ERR_CMD_NOT_FOUND) - 2) == 0 ||
-        strncmp(output, ERR_PIPE_CMD, strlen(ERR_PIPE_CMD) - 2) == 0) {
-        return 1;
+
+    //jobs, fg, bg, wait
+    if(jc_builtin(cmd, last_status)){
+        return 0;
+    }
+
+    //parallel [-j N] template ::: args
+    if(parallel_builtin(cmd, last_status)){
+        return 0;
+    }
+
+    //background jobs and direct-mode commands run under job control
+    if(background || direct){
+        *last_status = jc_run(cmd, background);
+        return 0;
     }
+    
+    //flush the prompt so captured output is not printed ahead of it
+    fflush(stdout);
+    ExecResult res;
+    exec_result_init(&res, CAPTURE_DEFAULT_LIMIT);
+
+    //execute command (pipeline or single); syntax errors land in res.err
+    execute_pipeline(cmd, EXEC_CAPTURE, &res);
+
+    //stdout and stderr arrive separately, so nothing has to be classified
+    capture_write(&res.out, STDOUT_FILENO);
+    capture_write(&res.err, STDERR_FILENO);
+    *last_status = res.exit_status;
+    exec_result_free(&res);
     return 0;
-}         
+}
+
+//runs a command list (a & b; c && d || (e; f)) one pipeline at a time, each one
+//deciding from its exit status what runs next; returns 1 on `exit`
+static int run_list(const char *line, int direct, int *last_status){
+    //holds the list for the current line only; its blocks are reused line after line
+    static Arena list_arena;
+    CmdList list;
+    int perr = parse_list(&list_arena, line, &list);
+    if(perr != PARSE_SUCCESS){
+        ExecResult res;
+        exec_result_init(&res, 0);
+        res.parse_err = perr;
+        exec_record_syntax_error(&res);
+        capture_write(&res.err, STDERR_FILENO);
+        *last_status = res.exit_status;
+        exec_result_free(&res);
+        arena_reset(&list_arena);
+        return 0;
+    }
+
+    const char *text;
+    int pos = 0, done = 0;
+    while(!done && (text = list_next(&list, &pos, *last_status)) != NULL){
+        //run_command() edits its argument in place
+        char *cmd = xstrdup(text);
+        done = run_command(cmd, direct, list.steps[pos - 1].background, last_status);
+        free(cmd);
+    }
+    arena_reset(&list_arena);
+    return done;
+}
+
+//runs every line of a script held in memory: no prompt, '#' starts a comment line
+static int run_script(const char *text, size_t len, int direct, int *last_status){
+    //grows to the longest line
+    char *cmd = NULL;
+    size_t cap = 0;
+    int done = 0;
+    for(size_t pos = 0; pos < len && !done; ){
+        const char *line = text + pos;
+        const char *nl = memchr(line, '\n', len - pos);
+        size_t n = nl ? (size_t)(nl - line) : len - pos;
+        pos += n + 1;
+
+        if(n + 1 > cap){
+            cap = n + 1;
+            cmd = realloc(cmd, cap);
+            if(!cmd){
+                perror("realloc");
+                exit(1);
+            }
+        }
+        memcpy(cmd, line, n);
+        cmd[n] = '\0';
+        if(n > 0 && cmd[n - 1] == '\r') cmd[n - 1] = '\0';
+
+        //skip blank lines, comments and the #! line
+        size_t lead = strspn(cmd, " \t");
+        if(cmd[lead] == '\0' || cmd[lead] == '#') continue;
+
+        jc_notify();
+        done = run_list(cmd, direct, last_status);
+    }
+    free(cmd);
+    return done;
+}
+
+//maps a script file (or reads it in one pass when it cannot be mapped, e.g. a pipe)
+//and runs it
+static int run_script_file(const char *path, int direct, int *last_status){
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0){
+        perror(path);
+        return 127;
+    }
+    struct stat st;
+    if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0){
+        void *text = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(text != MAP_FAILED){
+            close(fd);
+            madvise(text, st.st_size, MADV_SEQUENTIAL);
+            run_script(text, st.st_size, direct, last_status);
+            munmap(text, st.st_size);
+            return *last_status;
+        }
+    }
+
+    Capture text;
+    capture_init(&text, 0);
+    while(capture_fill(&text, fd) > 0);
+    close(fd);
+    char *s = capture_to_string(&text);
+    run_script(s, text.len, direct, last_status);
+    free(s);
+    capture_free(&text);
+    return *last_status;
+}
 
 /*Main function
 This function implements the main shell loop that reads commands and executes them
 It handles both single commands and pipelines, with proper error handling
+By default the last stage writes straight to the terminal; -C captures the output
+first and prints it afterwards (the same path the server uses)
+Every direct-mode command runs as a job in its own process group: `cmd &` starts it
+in the background, Ctrl-Z stops a foreground job, and jobs/fg/bg/wait manage them
 */
-int main() {
-    //buffer to store user input command
-    char cmd[MAX_CMD_LENGTH];
-    //array to store parsed command arguments
-    char *args[MAX_ARGS];
-    //point er to store redirection filenames
-    char *inputFile, *outputFile, *errorFile;
+int main(int argc, char *argv[]) {
+    //direct mode: children inherit our stdout/stderr, no capture step
+    int direct = 1;
+    //-c: run this text instead of reading commands
+    char *command_text = NULL;
+    int opt;
+    while((opt = getopt(argc, argv, "Cc:")) != -1){
+        switch(opt){
+            case 'C':
+                direct = 0;
+                break;
+            case 'c':
+                command_text = optarg;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-C] [-c command | script]\n", argv[0]);
+                return 1;
+        }
+    }
+    const char *script = (!command_text && optind < argc) ? argv[optind] : NULL;
+
+    //status of the last command (job control builtins and jobs report theirs)
+    int last_status = 0;
+
+    //batch modes: no prompt, no job control, stdout fully buffered (flushed before
+    //every child runs, so ordering with the children's output is preserved)
+    if(command_text || script){
+        static char outbuf[65536];
+        setvbuf(stdout, outbuf, _IOFBF, sizeof(outbuf));
+        jc_init(0);
+        if(command_text) run_script(command_text, strlen(command_text), direct, &last_status);
+        else last_status = run_script_file(script, direct, &last_status);
+        fflush(stdout);
+        jc_shutdown();
+        return last_status;
+    }
+
+    //buffer to store user input command; getline() grows it as needed
+    char *cmd = NULL;
+    size_t cmd_size = 0;
+
+    jc_init(isatty(STDIN_FILENO));
     
     while (1) {
+        //report background jobs that finished or stopped since the last prompt
+        jc_notify();
+
         //display shell prompt
         printf("$ ");
         
         //read command from user input
-        if (fgets(cmd, MAX_CMD_LENGTH, stdin) == NULL) {
+        if (getline(&cmd, &cmd_size, stdin) < 0) {
             break;
         }
         
@@ -66,89 +221,13 @@ int main() {
         if(strlen(cmd) == 0){
             continue;
         }
-        
-        //handle exit command
-        if(strcmp(cmd, "exit") == 0){
+
+        if(run_list(cmd, direct, &last_status)){
             break;
         }
-        
-        //execute command (pipeline or single)
-        if(strchr(cmd, '|') != NULL){
-            //command contains pipe symbol - execute as pipeline
-            // For standalone shell, use STDERR_FILENO for error output
-            char* output = execute_pipeline(cmd, STDERR_FILENO);
-            if(output) {
-                // Check if output is an error message
-                if(is_error_message(output)) {
-                    write(STDERR_FILENO, output, strlen(output));
-                } else {
-                    printf("%s", output);
-                }
-            }
-            if(output) free(output);
-        }else{
-            int outputAppend = 0;
-            int parse_res = parse_command(cmd, args, &inputFile, &outputFile, &errorFile, 0, &outputAppend);
-            if(parse_res == PARSE_SUCCESS){
-                //single command - parse and execute if parsing succeeded
-                char* output = execute_command(args, inputFile, outputFile, errorFile, outputAppend);
-                if(output) {
-                    // Check if output is an error message
-                    if(is_error_message(output)) {
-                        write(STDERR_FILENO, output, strlen(output));
-                    } else {
-                        printf("%s", output);
-                    }
-                }
-                if(output) free(output);
-
-                //free argv strings created by qtokenize/globbing
-                for(int i=0; args[i]!=NULL; i++){
-                    free(args[i]);
-                }
-                if(inputFile){
-                    free(inputFile);
-                }
-                if(outputFile){
-                    free(outputFile);
-                }
-                if(errorFile){
-                    free(errorFile);
-                }
-            } else {
-                // Handle parse errors for single commands
-                switch(parse_res){
-                    case PARSE_ERR_UNCLOSED_QUOTES:
-                        write(STDERR_FILENO, ERR_UNCLOSED_QUOTES, strlen(ERR_UNCLOSED_QUOTES));
-                        break;
-                    case PARSE_ERR_NO_INPUT_FILE:
-                        write(STDERR_FILENO, ERR_INPUT_NOT_SPECIFIED, strlen(ERR_INPUT_NOT_SPECIFIED));
-                        break;
-                    case PARSE_ERR_NO_OUTPUT_FILE:
-                        write(STDERR_FILENO, ERR_OUTPUT_NOT_SPECIFIED, strlen(ERR_OUTPUT_NOT_SPECIFIED));
-                        break;
-                    case PARSE_ERR_NO_OUTPUT_FILE_AFTER:
-                        write(STDERR_FILENO, ERR_OUTPUT_NOT_SPECIFIED_AFTER, strlen(ERR_OUTPUT_NOT_SPECIFIED_AFTER));
-                        break;
-                    case PARSE_ERR_NO_ERROR_FILE:
-                        write(STDERR_FILENO, ERR_ERROR_NOT_SPECIFIED, strlen(ERR_ERROR_NOT_SPECIFIED));
-                        break;
-                    default:
-                        // For other errors, just do nothing (syntax errors, etc.)
-                        break;
-                }
-                // Clean up any allocated args
-                if(args[0] != NULL){
-                    for(int i=0; args[i]!=NULL; i++){
-                        free(args[i]);
-                    }
-                }
-                if(inputFile) free(inputFile);
-                if(outputFile) free(outputFile);
-                if(errorFile) free(errorFile);
-            }
-        }
     }
     
-    return 0;
+    free(cmd);
+    jc_shutdown();
+    return last_status;
 }
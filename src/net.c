@@ -1,4 +1,14 @@
+#define _GNU_SOURCE
 #include "net.h"
+#include <sys/sendfile.h>
+#include <netinet/tcp.h>
+
+//frames are small and each is sent whole, so Nagle would only hold the next one
+//back until the peer's delayed ACK (~40 ms per command)
+static void set_nodelay(int fd){
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
 
 //creates and binds a server socket to the specified port, returns socket file descriptor on success, -1 on failure
 int create_server_socket(int port){
@@ -6,8 +16,8 @@ int create_server_socket(int port){
     struct sockaddr_in address;
     int opt = 1;
 
-    //create socket file descriptor
-    if((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0){
+    //create socket file descriptor (close-on-exec so spawned commands never hold it)
+    if((server_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0){
         perror("socket failed");
         return -1;
     }
@@ -31,8 +41,8 @@ int create_server_socket(int port){
         return -1;
     }
 
-    //start listening for connections
-    if(listen(server_fd, 3) < 0){
+    //start listening for connections; a burst of clients connecting at once must not overflow the queue
+    if(listen(server_fd, SOMAXCONN) < 0){
         perror("listen failed");
         close(server_fd);
         return -1;
@@ -49,13 +59,14 @@ int accept_client_connection(int server_fd, struct sockaddr_in *client_addr){
     int client_fd;
 
     // Use the passed client_addr struct to store address info
-    if((client_fd = accept(server_fd, (struct sockaddr *)client_addr, (socklen_t*)&addrlen)) < 0){
+    if((client_fd = accept4(server_fd, (struct sockaddr *)client_addr, (socklen_t*)&addrlen, SOCK_CLOEXEC)) < 0){
         // Don't print error for EINTR - it's handled by the caller
         if(errno != EINTR){
             perror("accept failed");
         }
         return -1;
     }
+    set_nodelay(client_fd);
     
     return client_fd;
 }
@@ -89,45 +100,94 @@ int create_client_socket(const char *server_ip, int port){
         return -1;
     }
 
+    set_nodelay(client_fd);
     printf("[INFO] Connected to server %s:%d\n", server_ip, port);
     return client_fd;
 }
 
-//sends a line of text over the socket, prefixed by its length.
-int send_line(int socket_fd, const char *line){
-    int len = strlen(line);
-    
-    // Send the line length first (as 4-byte network order integer)
-    int32_t net_len = htonl(len);
-    if(send(socket_fd, &net_len, sizeof(net_len), 0) != sizeof(net_len)){
+//sends all len bytes, retrying on short writes
+static int send_all(int socket_fd, const void *data, size_t len, int flags){
+    const char *p = data;
+    while(len > 0){
+        ssize_t n = send(socket_fd, p, len, flags);
+        if(n < 0){
+            if(errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+//with a payload to follow, MSG_MORE keeps the header for the same segment (no 4-byte packets)
+static int send_header(int socket_fd, int type, size_t len){
+    uint32_t net_len = htonl(((uint32_t)type << FRAME_TYPE_SHIFT) | (uint32_t)len);
+    if(send_all(socket_fd, &net_len, sizeof(net_len), len > 0 ? MSG_MORE : 0) < 0){
         perror("send length failed");
         return -1;
     }
+    return 0;
+}
 
-    // Send the actual line data
-    if(len > 0) { // Only send if there is data
-        if(send(socket_fd, line, len, 0) != len){
-            perror("send data failed");
+//sends one typed frame: header word followed by the payload
+int send_frame(int socket_fd, int type, const char *data, size_t len){
+    if(len > FRAME_LEN_MASK){
+        fprintf(stderr, "Frame too large (%zu bytes)\n", len);
+        return -1;
+    }
+    if(send_header(socket_fd, type, len) < 0) return -1;
+
+    // Only send if there is data
+    if(len > 0 && send_all(socket_fd, data, len, 0) < 0){
+        perror("send data failed");
+        return -1;
+    }
+    return (int)len;
+}
+
+//sends a region of a file as one frame; the payload goes kernel-to-socket via sendfile
+int send_frame_file(int socket_fd, int type, int file_fd, off_t offset, size_t len){
+    if(len > FRAME_LEN_MASK){
+        fprintf(stderr, "Frame too large (%zu bytes)\n", len);
+        return -1;
+    }
+    if(send_header(socket_fd, type, len) < 0) return -1;
+
+    size_t left = len;
+    while(left > 0){
+        ssize_t n = sendfile(socket_fd, file_fd, &offset, left);
+        if(n < 0){
+            if(errno == EINTR || errno == EAGAIN) continue;
+            perror("sendfile failed");
             return -1;
         }
+        if(n == 0) return -1;  // file shorter than announced; stream is now corrupt
+        left -= n;
     }
+    return (int)len;
+}
 
-    return len;
+//sends a line of text over the socket, prefixed by its length.
+int send_line(int socket_fd, const char *line){
+    return send_frame(socket_fd, FRAME_LINE, line, strlen(line));
 }
 
-//receives a line of text from the socket, reading the length prefix first.
-//Returns the number of bytes received, or 0/negative on error/EOF.
+//receives one frame from the socket, reading the header word first.
+//Returns the payload length, or 0/negative on error/EOF. *type receives the frame type.
 //Handles empty messages (line_len == 0) correctly.
-int receive_line(int socket_fd, char *buffer, int buffer_size){
-    int32_t net_len;
+int receive_frame(int socket_fd, int *type, char *buffer, int buffer_size){
+    uint32_t net_len;
     
-    // Receive the line length
+    // Receive the frame header
     ssize_t len_bytes = recv(socket_fd, &net_len, sizeof(net_len), MSG_WAITALL);
     if(len_bytes <= 0){
         return len_bytes; // Error or connection closed
     }
 
-    int line_len = ntohl(net_len);
+    uint32_t header = ntohl(net_len);
+    int line_len = header & FRAME_LEN_MASK;
+    if(type) *type = header >> FRAME_TYPE_SHIFT;
     
     if(line_len >= buffer_size){
         fprintf(stderr, "Received line too long (%d bytes) for buffer of size %d\n", line_len, buffer_size);
@@ -157,6 +217,46 @@ int receive_line(int socket_fd, char *buffer, int buffer_size){
     return line_len;
 }
 
+//receives one frame into a buffer grown to fit it (commands have no length limit
+//beyond the frame's). Returns the payload length, or 0/negative on error/EOF.
+int receive_frame_alloc(int socket_fd, int *type, char **buffer, size_t *size){
+    int line_len = receive_frame_header(socket_fd, type);
+    if(line_len < 0) return -1;
+
+    if((size_t)line_len + 1 > *size){
+        char *p = realloc(*buffer, line_len + 1);
+        if(!p){
+            perror("realloc");
+            return -1;
+        }
+        *buffer = p;
+        *size = line_len + 1;
+    }
+    if(line_len > 0 && recv(socket_fd, *buffer, line_len, MSG_WAITALL) != line_len){
+        (*buffer)[0] = '\0';
+        return -1;
+    }
+    (*buffer)[line_len] = '\0';
+    return line_len;
+}
+
+//reads just the header of the next frame; the payload stays on the socket
+int receive_frame_header(int socket_fd, int *type){
+    uint32_t net_len;
+    if(recv(socket_fd, &net_len, sizeof(net_len), MSG_WAITALL) != sizeof(net_len)){
+        return -1;
+    }
+    uint32_t header = ntohl(net_len);
+    if(type) *type = header >> FRAME_TYPE_SHIFT;
+    return header & FRAME_LEN_MASK;
+}
+
+//receives a line of text from the socket, reading the length prefix first.
+//Returns the number of bytes received, or 0/negative on error/EOF.
+int receive_line(int socket_fd, char *buffer, int buffer_size){
+    return receive_frame(socket_fd, NULL, buffer, buffer_size);
+}
+
 //closes a socket connection
 void close_socket(int socket_fd){
     if(socket_fd >= 0){
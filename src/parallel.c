@@ -0,0 +1,275 @@
+#include "parallel.h"
+#include "tokenize.h"
+#include "exec.h"
+#include "supervisor.h"
+#include "capture.h"
+#include "util.h"
+#include "globber.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+
+// GNU parallel caps its exit status at 101 failed jobs
+#define PAR_MAX_FAILED_STATUS 101
+#define PAR_USAGE "parallel: usage: parallel [-j N] command [{} {.} {/}] [::: arg... | :::: file]\n"
+
+typedef struct {
+    char **v;
+    int n, cap;
+} StrList;
+
+typedef struct {
+    char *p;
+    size_t len, cap;
+} StrBuf;
+
+typedef struct {
+    char *cmd;              // Template with the argument filled in
+    ExecResult res;
+    ExecJob job;
+    int done;
+    int *running;           // Shared count of tasks between start and completion
+} ParTask;
+
+static int strlist_push(StrList *l, char *s) {
+    if (l->n == l->cap) {
+        int cap = l->cap ? l->cap * 2 : 64;
+        char **v = realloc(l->v, cap * sizeof(char *));
+        if (!v) {
+            perror("realloc");
+            free(s);
+            return -1;
+        }
+        l->v = v;
+        l->cap = cap;
+    }
+    l->v[l->n++] = s;
+    return 0;
+}
+
+static void strlist_free(StrList *l) {
+    for (int i = 0; i < l->n; i++) free(l->v[i]);
+    free(l->v);
+}
+
+static void buf_put(StrBuf *b, const char *s, size_t n) {
+    if (b->len + n + 1 > b->cap) {
+        size_t cap = b->cap ? b->cap : 256;
+        while (cap < b->len + n + 1) cap *= 2;
+        char *p = realloc(b->p, cap);
+        if (!p) {
+            perror("realloc");
+            return;
+        }
+        b->p = p;
+        b->cap = cap;
+    }
+    memcpy(b->p + b->len, s, n);
+    b->len += n;
+    b->p[b->len] = '\0';
+}
+
+// Double-quotes s for the tokenizer (only \" and \\ are escapes inside "...")
+// so arguments with spaces or glob characters stay a single literal word
+static void buf_put_quoted(StrBuf *b, const char *s, size_t n) {
+    buf_put(b, "\"", 1);
+    for (size_t i = 0; i < n; i++) {
+        if (s[i] == '"' || s[i] == '\\') buf_put(b, "\\", 1);
+        buf_put(b, &s[i], 1);
+    }
+    buf_put(b, "\"", 1);
+}
+
+// Substitutes {}, {.} and {/} in tmpl; appends the argument if none occurs
+static char *expand_template(const char *tmpl, const char *arg) {
+    StrBuf b = { NULL, 0, 0 };
+    const char *base = strrchr(arg, '/');
+    base = base ? base + 1 : arg;
+    const char *dot = strrchr(base, '.');
+    size_t noext_len = (dot && dot != base) ? (size_t)(dot - arg) : strlen(arg);
+
+    int used = 0;
+    for (const char *p = tmpl; *p; ) {
+        if (strncmp(p, "{}", 2) == 0) {
+            buf_put_quoted(&b, arg, strlen(arg));
+            p += 2;
+        } else if (strncmp(p, "{.}", 3) == 0) {
+            buf_put_quoted(&b, arg, noext_len);
+            p += 3;
+        } else if (strncmp(p, "{/}", 3) == 0) {
+            buf_put_quoted(&b, base, strlen(base));
+            p += 3;
+        } else {
+            buf_put(&b, p++, 1);
+            continue;
+        }
+        used = 1;
+    }
+    if (!used) {
+        buf_put(&b, " ", 1);
+        buf_put_quoted(&b, arg, strlen(arg));
+    }
+    return b.p ? b.p : xstrdup("");
+}
+
+// Reads one argument per line; empty lines are skipped
+static int read_arg_lines(FILE *f, StrList *args) {
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t n;
+    while ((n = getline(&line, &cap, f)) >= 0) {
+        while (n > 0 && (line[n - 1] == '\n' || line[n - 1] == '\r')) line[--n] = '\0';
+        if (n == 0) continue;
+        if (strlist_push(args, xstrdup(line)) < 0) break;
+    }
+    free(line);
+    return 0;
+}
+
+// Globs an unquoted ::: argument; no match keeps the word, as for commands
+static void push_globbed(Arena *a, StrList *args, const char *word, int quoted) {
+    char **matches;
+    int n = (quoted || strpbrk(word, "*?[") == NULL) ? 0 : glob_expand(a, word, &matches);
+    // A pattern that matches nothing stays as it is
+    if (n == 0) strlist_push(args, xstrdup(word));
+    for (int i = 0; i < n; i++) strlist_push(args, xstrdup(matches[i]));
+}
+
+static void on_task_done(ExecJob *job, void *arg) {
+    (void)job;
+    ParTask *t = arg;
+    capture_finish(&t->res.out);
+    capture_finish(&t->res.err);
+    t->done = 1;
+    (*t->running)--;
+}
+
+// Runs every command with at most jobs in flight on one epoll supervisor and
+// prints results strictly in input order. Returns the number of failures.
+static int run_tasks(StrList *cmds, int jobs) {
+    Supervisor sv;
+    if (sv_init(&sv) < 0) return cmds->n;
+
+    ParTask *tasks = calloc(cmds->n, sizeof(ParTask));
+    if (!tasks) {
+        perror("calloc");
+        sv_destroy(&sv);
+        return cmds->n;
+    }
+    int running = 0, started = 0, printed = 0, failed = 0, interrupted = 0;
+    fflush(stdout);
+
+    while (printed < started || (started < cmds->n && !interrupted)) {
+        while (running < jobs && started < cmds->n && !interrupted) {
+            ParTask *t = &tasks[started++];
+            t->cmd = cmds->v[started - 1];
+            t->running = &running;
+            exec_result_init(&t->res, CAPTURE_DEFAULT_LIMIT);
+            running++;
+            exec_job_start(t->cmd, &t->res, &t->job, NULL);
+            sv_add(&sv, &t->job, on_task_done, t);
+        }
+
+        // Print every finished task whose predecessors are all out
+        while (printed < started && tasks[printed].done) {
+            ParTask *t = &tasks[printed++];
+            capture_write(&t->res.out, STDOUT_FILENO);
+            capture_write(&t->res.err, STDERR_FILENO);
+            if (t->res.exit_status != 0) {
+                failed++;
+                fprintf(stderr, "parallel: exit %d: %s\n", t->res.exit_status, t->cmd);
+                // Ctrl-C reached the workers: finish what runs, start nothing new
+                if (t->res.exit_status == 128 + SIGINT) interrupted = 1;
+            }
+            exec_result_free(&t->res);
+        }
+
+        if (running > 0 && sv_run_once(&sv, -1) < 0) break;
+    }
+
+    if (interrupted && started < cmds->n) {
+        fprintf(stderr, "parallel: interrupted, %d jobs not started\n", cmds->n - started);
+        failed += cmds->n - started;
+    }
+    free(tasks);
+    sv_destroy(&sv);
+    return failed;
+}
+
+int parallel_builtin(const char *cmd, int *status) {
+    Arena a = {0};
+    QTok *toks = NULL;
+    int nt = 0;
+    if (qtokenize(&a, cmd, &toks, &nt) != 0 || nt == 0 || toks[0].was_quoted || strcmp(toks[0].val, "parallel") != 0) {
+        arena_destroy(&a);
+        return 0;
+    }
+
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    int jobs = ncpu > 0 ? (int)ncpu : 1;
+    int i = 1;
+    if (i < nt && strncmp(toks[i].val, "-j", 2) == 0) {
+        const char *n = toks[i].val[2] ? toks[i].val + 2 : (i + 1 < nt ? toks[++i].val : "");
+        jobs = atoi(n);
+        i++;
+    }
+
+    // One quoted word is a whole command line ('gzip -c {} > {}.gz'); otherwise
+    // quoted words are re-quoted so they stay single arguments
+    int first = i;
+    while (i < nt && strcmp(toks[i].val, ":::") != 0 && strcmp(toks[i].val, "::::") != 0) i++;
+    StrBuf tmpl = { NULL, 0, 0 };
+    for (int w = first; w < i; w++) {
+        if (tmpl.len) buf_put(&tmpl, " ", 1);
+        if (toks[w].was_quoted && i - first > 1) buf_put_quoted(&tmpl, toks[w].val, strlen(toks[w].val));
+        else buf_put(&tmpl, toks[w].val, strlen(toks[w].val));
+    }
+
+    StrList args = { NULL, 0, 0 };
+    int bad = jobs < 1 || tmpl.len == 0;
+    if (!bad && i < nt && strcmp(toks[i].val, ":::") == 0) {
+        for (i++; i < nt; i++) push_globbed(&a, &args, toks[i].val, toks[i].was_quoted);
+    } else if (!bad && i < nt) {
+        // :::: file
+        if (i + 2 != nt) {
+            bad = 1;
+        } else if (strcmp(toks[i + 1].val, "-") == 0) {
+            read_arg_lines(stdin, &args);
+        } else {
+            FILE *f = fopen(toks[i + 1].val, "r");
+            if (!f) {
+                perror(toks[i + 1].val);
+                *status = 1;
+                free(tmpl.p);
+                arena_destroy(&a);
+                return 1;
+            }
+            read_arg_lines(f, &args);
+            fclose(f);
+        }
+    } else if (!bad) {
+        read_arg_lines(stdin, &args);
+    }
+    arena_destroy(&a);
+
+    if (bad) {
+        fputs(PAR_USAGE, stderr);
+        *status = 2;
+        free(tmpl.p);
+        strlist_free(&args);
+        return 1;
+    }
+
+    StrList cmds = { NULL, 0, 0 };
+    for (int a = 0; a < args.n; a++) strlist_push(&cmds, expand_template(tmpl.p, args.v[a]));
+    free(tmpl.p);
+    strlist_free(&args);
+
+    int failed = run_tasks(&cmds, jobs);
+    if (failed) fprintf(stderr, "parallel: %d of %d jobs failed\n", failed, cmds.n);
+    strlist_free(&cmds);
+    *status = failed > PAR_MAX_FAILED_STATUS ? PAR_MAX_FAILED_STATUS : failed;
+    return 1;
+}
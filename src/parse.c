@@ -1,6 +1,5 @@
 #include "parse.h"
 #include "tokenize.h"
-#include "util.h"
 #include "errors.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -8,171 +7,282 @@
 #include <stdbool.h>
 #include <unistd.h>
 
+// Returns the list operator token s is (";", "&", "&&", "||", "(" or ")"), or 0;
+// a lone & is 'b' (background)
+static int list_op(const char *s){
+    if(strcmp(s,";")==0 || strcmp(s,"(")==0 || strcmp(s,")")==0) return s[0];
+    if(strcmp(s,"&")==0) return 'b';
+    if(strcmp(s,"&&")==0) return '&';
+    if(strcmp(s,"||")==0) return '|';
+    return 0;
+}
 
-#define MAX_CMD_LENGTH 1024 
-#define MAX_ARGS 64         
+// Returns the redirection token s is ("<", ">", ">>" or "2>"), or 0
+static int redir_op(const char *s){
+    if(strcmp(s,"<")==0 || strcmp(s,">")==0) return s[0];
+    if(strcmp(s,">>")==0) return 'a';
+    if(strcmp(s,"2>")==0) return '2';
+    return 0;
+}
 
-static char* skip_whitespace(char *str){
-    while(*str == ' ' || *str == '\t' || *str == '\n'){
-        str++;
+// Index of the ')' closing the '(' at toks[i], or -1
+static int group_end(const QTok *toks, int nt, int i){
+    for(int depth=0;i<nt;i++){
+        if(toks[i].was_quoted) continue;
+        if(strcmp(toks[i].val,"(")==0) depth++;
+        else if(strcmp(toks[i].val,")")==0 && --depth==0) return i;
     }
-    return str;
+    return -1;
 }
 
-int validate_pipeline(char *cmd){
-    size_t n = strlen(cmd) + 1;
-    char buf[n];
-    memcpy(buf, cmd, n);
-
-    char *p = skip_whitespace(buf);
+static bool is_pipe_tok(const QTok *t){
+    return !t->was_quoted && strcmp(t->val,"|")==0;
+}
 
-    if (*p == '|') {
-        return VALIDATE_ERR_STARTS_PIPE;
+// Drops one pair of quotes still wrapping a token value (a file named as
+// "\"out\"" is out), in place
+static char *strip_quotes_inplace(char *s){
+    size_t len=strlen(s);
+    if(len>=2 && ((s[0]=='\'' && s[len-1]=='\'') || (s[0]=='"' && s[len-1]=='"'))){
+        s[len-1]='\0';
+        return s+1;
     }
+    return s;
+}
 
-    int saw_non_ws_since_pipe = 0;
-    for (char *q = p; *q; ++q) {
-        if (*q == '|') {
-            if (!saw_non_ws_since_pipe) {
-                return VALIDATE_ERR_EMPTY_CMD;
-            }
-            saw_non_ws_since_pipe = 0;
-        } else if (*q != ' ' && *q != '\t' && *q != '\n') {
-            saw_non_ws_since_pipe = 1;
-        }
-    }
+// Globs the words collected for one stage into its argv
+static void finish_stage(Arena *a, PlanStage *st, char **words, bool *quoted, int nw){
+    st->args = apply_globbing(a, words, quoted, &nw, &st->batch_start, &st->batch_end);
+}
 
-    if (!saw_non_ws_since_pipe) {
-        return VALIDATE_ERR_ENDS_PIPE;
+// Parses the text of a ( list ) stage into its list and a plan per pipeline.
+// Returns 0, or -1 with the first error in *verr or *perr.
+static int parse_group(Arena *a, const char *text, PlanGroup *g, int *verr, int *perr){
+    g->plans = NULL;
+    int err = parse_list(a, text, &g->list);
+    if(err==PARSE_SUCCESS && g->list.nsteps==0) err=PARSE_ERR_LIST_SYNTAX;  // ( )
+    if(err!=PARSE_SUCCESS){ *perr=err; return -1; }
+    g->plans = arena_alloc(a, g->list.nsteps*sizeof(Plan));
+    for(int k=0;k<g->list.nsteps;k++){
+        const ListStep *st = &g->list.steps[k];
+        if(st->kind!=LIST_PIPELINE) continue;
+        if(parse_plan(a, st->text, PLAN_AUTO, &g->plans[k])<0){
+            *verr=g->plans[k].validate_err;
+            *perr=g->plans[k].parse_err;
+            return -1;
+        }
     }
-
-    return VALIDATE_SUCCESS;
+    return 0;
 }
 
-int parse_command(char *cmd, char *args[], char **inputFile, char **outputFile, char **errorFile, int isPipeline, int *outputAppend){
-    (void)isPipeline; // isPipeline is now handled by the caller based on error code
-    *inputFile = *outputFile = *errorFile = NULL;
-    if(outputAppend) *outputAppend = 0; // Default to truncate mode
+int parse_plan(Arena *a, const char *cmd, int is_pipeline, Plan *plan){
+    plan->stages=NULL; plan->nstages=0;
+    plan->validate_err=VALIDATE_SUCCESS; plan->parse_err=PARSE_SUCCESS;
+    plan->globbed=0; plan->grouped=0;
 
     QTok *toks=NULL; int nt=0;
-    if(qtokenize(cmd, &toks, &nt)!=0){
-        args[0]=NULL; return PARSE_ERR_UNCLOSED_QUOTES;
-    }
-    if(nt==0){ args[0]=NULL; free_qtokens(toks,nt); return PARSE_ERR_SYNTAX; }
-
-    bool quoted[MAX_ARGS]; int ac=0;
-    for(int i=0;i<nt;i++){
-        if(ac>=MAX_ARGS-1){ 
-            // Free tokens that were already transferred to args
-            for(int k=0; k<ac; k++) free(args[k]);
-            // Free remaining tokens that were not transferred
-            for(int k=i; k<nt; k++) free(toks[k].val);
-            free(toks);
-            args[0]=NULL; 
-            return PARSE_ERR_TOO_MANY_ARGS; 
-        }
-        args[ac] = toks[i].val;
-        quoted[ac] = toks[i].was_quoted;
-        ac++;
-    }
-    free(toks); // The container is freed, but the strings are now owned by 'args'
-
-    for(int i=0;i<ac;i++){
-        if(!quoted[i] && (strcmp(args[i],"<")==0 || strcmp(args[i],">")==0 || strcmp(args[i],">>")==0 || strcmp(args[i],"2>")==0)){
-            if(i+1>=ac || args[i+1] == NULL || strlen(args[i+1]) == 0){ 
-                int err_code = PARSE_ERR_SYNTAX;
-                if(strcmp(args[i],"<")==0) err_code = PARSE_ERR_NO_INPUT_FILE;
-                else if(strcmp(args[i],">")==0 || strcmp(args[i],">>")==0) err_code = isPipeline ? PARSE_ERR_NO_OUTPUT_FILE_AFTER : PARSE_ERR_NO_OUTPUT_FILE;
-                else err_code = PARSE_ERR_NO_ERROR_FILE;
-
-                for(int k=0;k<ac;k++) free(args[k]);
-                args[0]=NULL; 
-                return err_code;
-            }
-        }
-    }
+    if(qtokenize(a, cmd, &toks, &nt)!=0){ plan->parse_err=PARSE_ERR_UNCLOSED_QUOTES; return -1; }
 
-    char *argv2[MAX_ARGS]; bool quoted2[MAX_ARGS]; int m=0;
-    for(int i=0;i<ac;i++){
-        if(!quoted[i] && strcmp(args[i],"<")==0){
-            char *fname = strip_outer_quotes(args[i+1]);
-            if(fname == NULL || strlen(fname) == 0){
-                if(fname) free(fname);
-                for(int k=0;k<ac;k++) free(args[k]);
-                args[0]=NULL; 
-                return PARSE_ERR_NO_INPUT_FILE;
+    // Pipe structure errors win over stage errors; otherwise the first one counts
+    int verr=VALIDATE_SUCCESS, perr=PARSE_SUCCESS, cap=0, has_pipe=0;
+    // Words of the stage being collected; both arrays grow together
+    char **words=NULL; bool *quoted=NULL; int nw=0, wcap=0;
+    PlanStage cur={0};
+    int has_redir=0;
+
+    for(int i=0;i<=nt;i++){
+        QTok *t = i<nt ? &toks[i] : NULL;
+        int redir = (t && !t->was_quoted) ? redir_op(t->val) : 0;
+        int list = (t && !t->was_quoted) ? list_op(t->val) : 0;
+        int pipe = t && !t->was_quoted && strcmp(t->val,"|")==0;
+
+        if(t && !redir && !list && !pipe){
+            if(cur.group){ if(!perr) perr=PARSE_ERR_LIST_SYNTAX; continue; }  // (a) b
+            if(nw==wcap){
+                wcap = wcap ? wcap*2 : 16;
+                char **w = arena_alloc(a, wcap*sizeof(char*));
+                bool *q = arena_alloc(a, wcap*sizeof(bool));
+                if(nw){ memcpy(w, words, nw*sizeof(char*)); memcpy(q, quoted, nw*sizeof(bool)); }
+                words=w; quoted=q;
             }
-            *inputFile = fname;
-            free(args[i]); free(args[i+1]);
-            i++; continue;
-        }else if(!quoted[i] && strcmp(args[i],">>")==0){
-            // Check if filename is missing or empty
-            if(i+1 >= ac || args[i+1] == NULL || strlen(args[i+1]) == 0){
-                for(int k=0;k<ac;k++) free(args[k]);
-                args[0]=NULL; 
-                // Use "after redirection" message when in pipeline context
-                return isPipeline ? PARSE_ERR_NO_OUTPUT_FILE_AFTER : PARSE_ERR_NO_OUTPUT_FILE;
+            words[nw]=t->val; quoted[nw]=t->was_quoted; nw++;
+            if(!t->was_quoted && strpbrk(t->val, "*?[]")) plan->globbed=1;
+            continue;
+        }
+        if(redir){
+            QTok *target = i+1<nt ? &toks[i+1] : NULL;
+            if(target && !target->was_quoted && (redir_op(target->val) || list_op(target->val) || strcmp(target->val,"|")==0)) target=NULL;
+            char *fname = target ? strip_quotes_inplace(target->val) : NULL;
+            if(!fname || !*fname){
+                if(!perr) perr = redir=='<' ? PARSE_ERR_NO_INPUT_FILE : redir=='2' ? PARSE_ERR_NO_ERROR_FILE : PARSE_ERR_NO_OUTPUT_FILE;
+                continue;
             }
-            char *fname = strip_outer_quotes(args[i+1]);
-            if(fname == NULL || strlen(fname) == 0){
-                if(fname) free(fname);
-                for(int k=0;k<ac;k++) free(args[k]);
-                args[0]=NULL; 
-                // Use "after redirection" message when in pipeline context
-                return isPipeline ? PARSE_ERR_NO_OUTPUT_FILE_AFTER : PARSE_ERR_NO_OUTPUT_FILE;
+            if(redir=='<') cur.inputFile=fname;
+            else if(redir=='2') cur.errorFile=fname;
+            else { cur.outputFile=fname; cur.outputAppend = redir=='a'; }
+            has_redir=1;
+            i++;
+            continue;
+        }
+        if(list){
+            // A ( list ) opening a stage runs as that stage; any other list operator
+            // was left here by mistake
+            int end = (list=='(' && nw==0 && !cur.group) ? group_end(toks, nt, i) : -1;
+            if(end<0){
+                if(!perr) perr = (list=='(' && nw==0 && !cur.group) ? PARSE_ERR_UNMATCHED_PAREN : PARSE_ERR_LIST_SYNTAX;
+                continue;
             }
-            *outputFile = fname;
-            if(outputAppend) *outputAppend = 1; // Set append mode
-            free(args[i]); free(args[i+1]);
-            i++; continue;
-        }else if(!quoted[i] && strcmp(args[i],">")==0){
-            // Check if filename is missing or empty
-            if(i+1 >= ac || args[i+1] == NULL || strlen(args[i+1]) == 0){
-                for(int k=0;k<ac;k++) free(args[k]);
-                args[0]=NULL; 
-                // Use "after redirection" message when in pipeline context
-                return isPipeline ? PARSE_ERR_NO_OUTPUT_FILE_AFTER : PARSE_ERR_NO_OUTPUT_FILE;
+            char *text = arena_strndup(a, cmd+t->end, toks[end].start - t->end);
+            int gverr=VALIDATE_SUCCESS, gperr=PARSE_SUCCESS;
+            cur.group = arena_alloc(a, sizeof(PlanGroup));
+            if(parse_group(a, text, cur.group, &gverr, &gperr)<0){
+                if(gverr && !verr) verr=gverr;
+                if(gperr && !perr) perr=gperr;
             }
-            char *fname = strip_outer_quotes(args[i+1]);
-            if(fname == NULL || strlen(fname) == 0){
-                if(fname) free(fname);
-                for(int k=0;k<ac;k++) free(args[k]);
-                args[0]=NULL; 
-                // Use "after redirection" message when in pipeline context
-                return isPipeline ? PARSE_ERR_NO_OUTPUT_FILE_AFTER : PARSE_ERR_NO_OUTPUT_FILE;
+            plan->grouped=1;
+            i=end;
+            continue;
+        }
+
+        // A pipe or the end of the line closes the stage
+        if(nw==0 && !cur.group && !has_redir){
+            if(!verr) verr = pipe ? (plan->nstages==0 && !has_pipe ? VALIDATE_ERR_STARTS_PIPE : VALIDATE_ERR_EMPTY_CMD) : VALIDATE_ERR_ENDS_PIPE;
+        }else if(nw==0 && !cur.group){
+            if(!perr) perr=PARSE_ERR_EMPTY_CMD_REDIR;
+        }
+        // Once something failed nothing will run: skip the globbing
+        if((nw>0 || cur.group) && !verr && !perr){
+            if(plan->nstages==cap){
+                cap = cap ? cap*2 : 4;
+                PlanStage *tmp = arena_alloc(a, cap*sizeof(PlanStage));
+                if(plan->nstages) memcpy(tmp, plan->stages, plan->nstages*sizeof(PlanStage));
+                plan->stages=tmp;
             }
-            *outputFile = fname;
-            if(outputAppend) *outputAppend = 0; // Set truncate mode
-            free(args[i]); free(args[i+1]);
-            i++; continue;
-        }else if(!quoted[i] && strcmp(args[i],"2>")==0){
-            char *fname = strip_outer_quotes(args[i+1]);
-            if(fname == NULL || strlen(fname) == 0){
-                if(fname) free(fname);
-                for(int k=0;k<ac;k++) free(args[k]);
-                args[0]=NULL; 
-                return PARSE_ERR_NO_ERROR_FILE;
+            if(cur.group){
+                // Shown where a stage's command name would be (logs, messages)
+                cur.args = arena_alloc(a, 2*sizeof(char*));
+                cur.args[0] = "(";
+                cur.args[1] = NULL;
+            }else{
+                finish_stage(a, &cur, words, quoted, nw);
             }
-            *errorFile = fname;
-            free(args[i]); free(args[i+1]);
-            i++; continue;
-        }else{
-            argv2[m]=args[i]; quoted2[m]=quoted[i]; m++;
+            plan->stages[plan->nstages++]=cur;
         }
+        memset(&cur, 0, sizeof(cur));
+        nw=0; has_redir=0;
+        if(pipe) has_pipe=1;
     }
-    argv2[m]=NULL;
 
-    if(m==0){
-        if(*inputFile){ free(*inputFile); *inputFile=NULL; }
-        if(*outputFile){ free(*outputFile); *outputFile=NULL; }
-        if(*errorFile){ free(*errorFile); *errorFile=NULL; }
-        args[0]=NULL; return PARSE_ERR_EMPTY_CMD_REDIR;
+    if(verr) perr=PARSE_SUCCESS;
+    if(perr==PARSE_ERR_NO_OUTPUT_FILE && (is_pipeline==1 || (is_pipeline==PLAN_AUTO && has_pipe))) perr=PARSE_ERR_NO_OUTPUT_FILE_AFTER;
+    plan->validate_err=verr;
+    plan->parse_err=perr;
+    if(verr || perr){
+        plan->stages=NULL;
+        plan->nstages=0;
+        return -1;
+    }
+    return 0;
+}
+
+static int push_step(Arena *a, CmdList *list, int *cap, ListStepKind kind, ListOp op, char *text){
+    if(list->nsteps==*cap){
+        *cap = *cap ? *cap*2 : 8;
+        ListStep *tmp = arena_alloc(a, *cap*sizeof(ListStep));
+        if(list->nsteps) memcpy(tmp, list->steps, list->nsteps*sizeof(ListStep));
+        list->steps = tmp;
     }
+    list->steps[list->nsteps] = (ListStep){ kind, op, text, list->nsteps+1, 0 };
+    return list->nsteps++;
+}
+
+// What the last token left us with, to reject misplaced operators
+enum { AT_START, AT_WORD, AT_GROUP_END, AT_AND_OR, AT_SEMI };
+
+int parse_list(Arena *a, const char *cmd, CmdList *list){
+    list->steps=NULL; list->nsteps=0;
+    QTok *toks=NULL; int nt=0;
+    if(qtokenize(a, cmd, &toks, &nt)!=0) return PARSE_ERR_UNCLOSED_QUOTES;
+
+    int cap=0, depth=0, err=PARSE_SUCCESS;
+    int open_at[nt>0 ? nt : 1];  // Step index of each unclosed '('
+    int piece=-1;                // First token of the pipeline being collected
+    int at=AT_START;
+    ListOp op=LIST_SEQ;
 
-    apply_globbing(argv2, quoted2, &m);
+    for(int i=0;i<=nt && err==PARSE_SUCCESS;i++){
+        int c = (i<nt && !toks[i].was_quoted) ? list_op(toks[i].val) : 0;
+        if(c=='('){
+            // Piped, redirected or backgrounded as a whole, the group is a stage of
+            // this pipeline (parse_plan() runs it in a subshell) rather than a list
+            int end = group_end(toks, nt, i);
+            const QTok *next = end>0 && end+1<nt && !toks[end+1].was_quoted ? &toks[end+1] : NULL;
+            if(end>0 && ((i>0 && is_pipe_tok(&toks[i-1])) ||
+                         (next && (is_pipe_tok(next) || redir_op(next->val) || list_op(next->val)=='b')))){
+                if(at==AT_GROUP_END){ err=PARSE_ERR_LIST_SYNTAX; break; }  // (a) (b) | c
+                if(piece<0) piece=i;
+                i=end;
+                at=AT_WORD;
+                continue;
+            }
+        }
+        if(i<nt && !c){
+            if(at==AT_GROUP_END){ err=PARSE_ERR_LIST_SYNTAX; break; }  // (a) b
+            if(piece<0) piece=i;
+            at=AT_WORD;
+            continue;
+        }
+        // An operator or the end of the line finishes the pipeline in progress
+        if(piece>=0){
+            char *text = arena_strndup(a, cmd+toks[piece].start, toks[i-1].end - toks[piece].start);
+            push_step(a, list, &cap, LIST_PIPELINE, op, text);
+            piece=-1;
+        }
+        if(i==nt) break;
 
-    for(int i=0;i<m;i++) args[i]=argv2[i];
-    args[m]=NULL;
+        if(c=='('){
+            if(at==AT_WORD || at==AT_GROUP_END){ err=PARSE_ERR_LIST_SYNTAX; break; }
+            open_at[depth++] = push_step(a, list, &cap, LIST_GROUP_OPEN, op, NULL);
+            op=LIST_SEQ;
+            at=AT_START;
+        }else if(c==')'){
+            if(depth==0){ err=PARSE_ERR_UNMATCHED_PAREN; break; }
+            // Not empty and not ending in && or ||; a trailing ; is fine
+            if(at==AT_START || at==AT_AND_OR){ err=PARSE_ERR_LIST_SYNTAX; break; }
+            int step = push_step(a, list, &cap, LIST_GROUP_CLOSE, LIST_SEQ, NULL);
+            list->steps[open_at[--depth]].skip = step+1;
+            at=AT_GROUP_END;
+        }else if(c=='b'){
+            // Backgrounds the pipeline just collected, then joins like ;
+            if(at!=AT_WORD){ err = at==AT_START || at==AT_SEMI ? PARSE_ERR_MISSING_BEFORE_BG : PARSE_ERR_LIST_SYNTAX; break; }
+            list->steps[list->nsteps-1].background=1;
+            op=LIST_SEQ;
+            at=AT_SEMI;
+        }else{
+            if(at!=AT_WORD && at!=AT_GROUP_END){ err=PARSE_ERR_LIST_SYNTAX; break; }
+            op = c==';' ? LIST_SEQ : c=='&' ? LIST_AND : LIST_OR;
+            at = c==';' ? AT_SEMI : AT_AND_OR;
+        }
+    }
+    if(err==PARSE_SUCCESS && at==AT_AND_OR) err=PARSE_ERR_LIST_SYNTAX;
+    if(err==PARSE_SUCCESS && depth>0) err=PARSE_ERR_UNMATCHED_PAREN;
 
-    return PARSE_SUCCESS;
+    if(err!=PARSE_SUCCESS){
+        list->steps=NULL;
+        list->nsteps=0;
+    }
+    return err;
+}
+
+const char *list_next(const CmdList *list, int *pos, int status){
+    while(*pos < list->nsteps){
+        const ListStep *st = &list->steps[*pos];
+        // A skipped command leaves the status alone, so `false && a || b` runs b
+        int run = st->kind==LIST_GROUP_CLOSE || st->op==LIST_SEQ ||
+                  (st->op==LIST_AND && status==0) || (st->op==LIST_OR && status!=0);
+        if(!run){ *pos = st->skip; continue; }
+        (*pos)++;
+        if(st->kind==LIST_PIPELINE) return st->text;
+    }
+    return NULL;
 }
@@ -0,0 +1,138 @@
+#include "plancache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void plan_cache_init(PlanCache *pc, int max_entries) {
+    memset(pc, 0, sizeof(*pc));
+    pc->max_entries = max_entries > 0 ? max_entries : 0;
+    pthread_mutex_init(&pc->lock, NULL);
+}
+
+static void free_entry(PlanEntry *e) {
+    arena_destroy(&e->arena);
+    free(e);
+}
+
+void plan_cache_destroy(PlanCache *pc) {
+    while (pc->newest) {
+        PlanEntry *e = pc->newest;
+        pc->newest = e->older;
+        free_entry(e);
+    }
+    pthread_mutex_destroy(&pc->lock);
+}
+
+// FNV-1a
+static unsigned bucket_of(const char *text) {
+    unsigned h = 2166136261u;
+    for (const char *p = text; *p; p++) {
+        h ^= (unsigned char)*p;
+        h *= 16777619u;
+    }
+    return h % PLAN_CACHE_BUCKETS;
+}
+
+// LRU list helpers; caller holds the lock
+static void lru_unlink(PlanCache *pc, PlanEntry *e) {
+    if (e->newer) e->newer->older = e->older;
+    else pc->newest = e->older;
+    if (e->older) e->older->newer = e->newer;
+    else pc->oldest = e->newer;
+    e->newer = e->older = NULL;
+}
+
+static void lru_push(PlanCache *pc, PlanEntry *e) {
+    e->newer = NULL;
+    e->older = pc->newest;
+    if (pc->newest) pc->newest->newer = e;
+    else pc->oldest = e;
+    pc->newest = e;
+}
+
+PlanEntry *plan_cache_lookup(PlanCache *pc, const char *cmd) {
+    if (pc->max_entries == 0) return NULL;
+    unsigned b = bucket_of(cmd);
+    pthread_mutex_lock(&pc->lock);
+    PlanEntry *e = pc->buckets[b];
+    while (e && strcmp(e->text, cmd) != 0) e = e->next;
+    if (e) {
+        e->refs++;
+        lru_unlink(pc, e);
+        lru_push(pc, e);
+    }
+    pthread_mutex_unlock(&pc->lock);
+    return e;
+}
+
+void plan_cache_release(PlanCache *pc, PlanEntry *e) {
+    pthread_mutex_lock(&pc->lock);
+    int left = --e->refs;
+    pthread_mutex_unlock(&pc->lock);
+    // Evicted while a caller was still forking from it
+    if (left == 0) free_entry(e);
+}
+
+// Drops the least recently used entry from the table; it is freed once the last
+// caller holding it lets go. Caller holds the lock.
+static void evict_oldest(PlanCache *pc) {
+    PlanEntry *e = pc->oldest;
+    lru_unlink(pc, e);
+    for (PlanEntry **link = &pc->buckets[bucket_of(e->text)]; *link; link = &(*link)->next) {
+        if (*link == e) {
+            *link = e->next;
+            break;
+        }
+    }
+    pc->nentries--;
+    if (--e->refs == 0) free_entry(e);
+}
+
+void plan_cache_insert(PlanCache *pc, const char *cmd, const Plan *plan) {
+    if (pc->max_entries == 0 || plan->globbed || plan->grouped || plan->nstages == 0) return;
+
+    PlanEntry *e = calloc(1, sizeof(*e));
+    if (!e) {
+        perror("calloc");
+        return;
+    }
+    // Deep copy into the entry's own arena: the caller's plan is about to be reset
+    Arena *a = &e->arena;
+    e->text = arena_strdup(a, cmd);
+    e->plan = *plan;
+    e->plan.stages = arena_alloc(a, plan->nstages * sizeof(PlanStage));
+    for (int i = 0; i < plan->nstages; i++) {
+        const PlanStage *src = &plan->stages[i];
+        PlanStage *dst = &e->plan.stages[i];
+        int argc = 0;
+        while (src->args[argc]) argc++;
+        dst->args = arena_alloc(a, (argc + 1) * sizeof(char *));
+        for (int j = 0; j < argc; j++) dst->args[j] = arena_strdup(a, src->args[j]);
+        dst->args[argc] = NULL;
+        dst->inputFile = src->inputFile ? arena_strdup(a, src->inputFile) : NULL;
+        dst->outputFile = src->outputFile ? arena_strdup(a, src->outputFile) : NULL;
+        dst->errorFile = src->errorFile ? arena_strdup(a, src->errorFile) : NULL;
+        dst->outputAppend = src->outputAppend;
+        dst->batch_start = src->batch_start;
+        dst->batch_end = src->batch_end;
+        dst->group = NULL;  // Plans with groups are never cached
+    }
+    e->refs = 1;
+
+    unsigned b = bucket_of(cmd);
+    pthread_mutex_lock(&pc->lock);
+    // Another thread may have parsed the same text meanwhile: keep the first
+    for (PlanEntry *o = pc->buckets[b]; o; o = o->next) {
+        if (strcmp(o->text, cmd) == 0) {
+            pthread_mutex_unlock(&pc->lock);
+            free_entry(e);
+            return;
+        }
+    }
+    if (pc->nentries >= pc->max_entries) evict_oldest(pc);
+    e->next = pc->buckets[b];
+    pc->buckets[b] = e;
+    lru_push(pc, e);
+    pc->nentries++;
+    pthread_mutex_unlock(&pc->lock);
+}
@@ -0,0 +1,262 @@
+#include "rcache.h"
+#include "parse.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+
+
+// What a key records about each file a command names
+typedef struct {
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    long long mtime_ns;
+} FileStamp;
+
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+int rcache_init(ResultCache *rc, const char *pure_list, long ttl_ms) {
+    memset(rc, 0, sizeof(*rc));
+    rc->ttl_ms = ttl_ms > 0 ? ttl_ms : RCACHE_DEFAULT_TTL_MS;
+    pthread_mutex_init(&rc->lock, NULL);
+    if (!pure_list) return 0;
+
+    char *list = xstrdup(pure_list);
+    int cap = 1;
+    for (char *p = list; *p; p++) if (*p == ',') cap++;
+    rc->pure = calloc(cap, sizeof(char *));
+    if (!rc->pure) {
+        perror("calloc");
+        free(list);
+        return -1;
+    }
+    char *saveptr;
+    for (char *name = strtok_r(list, ",", &saveptr); name; name = strtok_r(NULL, ",", &saveptr)) {
+        rc->pure[rc->npure++] = xstrdup(name);
+    }
+    free(list);
+    return 0;
+}
+
+static void free_entry(RCacheEntry *e) {
+    free(e->key);
+    free(e->out);
+    free(e->err);
+    free(e);
+}
+
+void rcache_destroy(ResultCache *rc) {
+    for (int b = 0; b < RCACHE_BUCKETS; b++) {
+        while (rc->buckets[b]) {
+            RCacheEntry *e = rc->buckets[b];
+            rc->buckets[b] = e->next;
+            free_entry(e);
+        }
+    }
+    for (int i = 0; i < rc->npure; i++) free(rc->pure[i]);
+    free(rc->pure);
+    pthread_mutex_destroy(&rc->lock);
+}
+
+int rcache_enabled(const ResultCache *rc) {
+    return rc->npure > 0;
+}
+
+static int is_pure(const ResultCache *rc, const char *argv0) {
+    const char *base = strrchr(argv0, '/');
+    base = base ? base + 1 : argv0;
+    for (int i = 0; i < rc->npure; i++) {
+        if (strcmp(rc->pure[i], base) == 0) return 1;
+    }
+    return 0;
+}
+
+// Appends n bytes to the growing key; returns -1 on allocation failure
+static int key_put(char **key, size_t *len, size_t *cap, const void *data, size_t n) {
+    if (*len + n > *cap) {
+        size_t c = *cap ? *cap : 256;
+        while (c < *len + n) c *= 2;
+        char *p = realloc(*key, c);
+        if (!p) {
+            perror("realloc");
+            return -1;
+        }
+        *key = p;
+        *cap = c;
+    }
+    memcpy(*key + *len, data, n);
+    *len += n;
+    return 0;
+}
+
+// Appends the stamp of path, or an all-zero stamp if it does not name a file
+static int key_put_stamp(char **key, size_t *len, size_t *cap, const char *path) {
+    FileStamp fs;
+    struct stat st;
+    memset(&fs, 0, sizeof(fs));
+    if (stat(path, &st) == 0) {
+        fs.dev = st.st_dev;
+        fs.ino = st.st_ino;
+        fs.size = st.st_size;
+        fs.mtime_ns = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    }
+    return key_put(key, len, cap, &fs, sizeof(fs));
+}
+
+char *rcache_key(const ResultCache *rc, const char *cmd, size_t *len) {
+    if (!rcache_enabled(rc)) return NULL;
+
+    Arena a = {0};
+    Plan plan;
+    if (parse_plan(&a, cmd, 0, &plan) < 0) {
+        arena_destroy(&a);
+        return NULL;
+    }
+    PlanStage *st = &plan.stages[0];
+    char **args = st->args;
+
+    char *key = NULL;
+    size_t cap = 0;
+    *len = 0;
+    int ok = plan.nstages == 1 && !st->outputFile && !st->errorFile && is_pure(rc, args[0]);
+
+    // argv, NUL-separated, then the input redirection, then the file stamps
+    for (int i = 0; ok && args[i]; i++) {
+        ok = key_put(&key, len, &cap, args[i], strlen(args[i]) + 1) == 0;
+    }
+    if (ok && st->inputFile) {
+        ok = key_put(&key, len, &cap, "<", 1) == 0 &&
+             key_put(&key, len, &cap, st->inputFile, strlen(st->inputFile) + 1) == 0 &&
+             key_put_stamp(&key, len, &cap, st->inputFile) == 0;
+    }
+    for (int i = 1; ok && args[i]; i++) {
+        ok = key_put_stamp(&key, len, &cap, args[i]) == 0;
+    }
+
+    arena_destroy(&a);
+    if (!ok) {
+        free(key);
+        return NULL;
+    }
+    return key;
+}
+
+// FNV-1a
+static unsigned bucket_of(const char *key, size_t len) {
+    unsigned h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)key[i];
+        h *= 16777619u;
+    }
+    return h % RCACHE_BUCKETS;
+}
+
+// Unlinks *link's entry; caller holds the lock
+static void drop_entry(ResultCache *rc, RCacheEntry **link) {
+    RCacheEntry *e = *link;
+    *link = e->next;
+    free_entry(e);
+    rc->nentries--;
+}
+
+int rcache_lookup(ResultCache *rc, const char *key, size_t len, ExecResult *res) {
+    int hit = 0;
+    long long now = now_ms();
+    pthread_mutex_lock(&rc->lock);
+    RCacheEntry **link = &rc->buckets[bucket_of(key, len)];
+    while (*link) {
+        RCacheEntry *e = *link;
+        if (e->expires_ms <= now) {
+            drop_entry(rc, link);
+            continue;
+        }
+        if (e->key_len == len && memcmp(e->key, key, len) == 0) {
+            capture_append(&res->out, e->out, e->out_len);
+            capture_append(&res->err, e->err, e->err_len);
+            res->exit_status = e->exit_status;
+            hit = 1;
+            break;
+        }
+        link = &e->next;
+    }
+    pthread_mutex_unlock(&rc->lock);
+    return hit;
+}
+
+// Makes room for one more entry: drops everything expired and, if the cache is
+// still full, the entry closest to expiry. Caller holds the lock.
+static void evict(ResultCache *rc, long long now) {
+    RCacheEntry **oldest = NULL;
+    for (int b = 0; b < RCACHE_BUCKETS; b++) {
+        RCacheEntry **link = &rc->buckets[b];
+        while (*link) {
+            if ((*link)->expires_ms <= now) {
+                drop_entry(rc, link);
+                continue;
+            }
+            if (!oldest || (*link)->expires_ms < (*oldest)->expires_ms) oldest = link;
+            link = &(*link)->next;
+        }
+    }
+    if (rc->nentries >= RCACHE_MAX_ENTRIES && oldest) drop_entry(rc, oldest);
+}
+
+// Copies a capture (in memory or spilled) into a fresh buffer, or returns NULL
+static char *copy_capture(const Capture *c) {
+    char *buf = malloc(c->len ? c->len : 1);
+    if (!buf) return NULL;
+    for (size_t done = 0; done < c->len; ) {
+        ssize_t r = capture_pread(c, buf + done, c->len - done, done);
+        if (r <= 0) {
+            free(buf);
+            return NULL;
+        }
+        done += r;
+    }
+    return buf;
+}
+
+void rcache_store(ResultCache *rc, const char *key, size_t len, const ExecResult *res) {
+    if (res->exit_status != 0 || res->out.truncated || res->err.truncated) return;
+    if (res->out.len + res->err.len > RCACHE_ENTRY_MAX) return;
+
+    RCacheEntry *e = calloc(1, sizeof(*e));
+    if (!e) return;
+    e->key = malloc(len);
+    e->out = copy_capture(&res->out);
+    e->err = copy_capture(&res->err);
+    if (!e->key || !e->out || !e->err) {
+        free_entry(e);
+        return;
+    }
+    memcpy(e->key, key, len);
+    e->key_len = len;
+    e->out_len = res->out.len;
+    e->err_len = res->err.len;
+    e->exit_status = res->exit_status;
+
+    long long now = now_ms();
+    e->expires_ms = now + rc->ttl_ms;
+    unsigned b = bucket_of(key, len);
+
+    pthread_mutex_lock(&rc->lock);
+    // A concurrent run of the same command may have stored it already: replace
+    for (RCacheEntry **link = &rc->buckets[b]; *link; link = &(*link)->next) {
+        if ((*link)->key_len == len && memcmp((*link)->key, key, len) == 0) {
+            drop_entry(rc, link);
+            break;
+        }
+    }
+    if (rc->nentries >= RCACHE_MAX_ENTRIES) evict(rc, now);
+    e->next = rc->buckets[b];
+    rc->buckets[b] = e;
+    rc->nentries++;
+    pthread_mutex_unlock(&rc->lock);
+}
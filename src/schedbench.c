@@ -0,0 +1,304 @@
+#define _GNU_SOURCE
+#include "scheduler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+
+// Stress benchmark for the scheduler's queue operations at depths of 10^3 to
+// 10^6 demo jobs. For each depth it times, under the queue lock as the server
+// runs them:
+//   enqueue        sched_add() (appends, walking the queue)
+//   decision       sched_next() (select_job(): two or three passes over the queue)
+//   preempt_check  sched_should_preempt() (the scan after every tick)
+// With -t N, N submitter threads enqueue while this thread keeps deciding, and
+// the time spent waiting for the lock shows up next to the hold time. Prints
+// one CSV row per depth and operation.
+
+typedef struct {
+    double *hold, *wait;        // ns per sample
+    int n;
+} Timings;
+
+typedef struct {
+    Scheduler *s;
+    Job *jobs;                  // This submitter's jobs to enqueue
+    int count;
+    Timings t;
+} Submitter;
+
+static unsigned long long g_rng = 88172645463325252ULL;
+
+static unsigned rng_next(void) {
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 7;
+    g_rng ^= g_rng << 17;
+    return (unsigned)(g_rng >> 32);
+}
+
+// Mostly short jobs, some medium, a few long ones
+static int random_burst(void) {
+    unsigned r = rng_next() % 100;
+    if (r < 70) return 1 + rng_next() % 10;
+    if (r < 95) return 10 + rng_next() % 90;
+    return 100 + rng_next() % 900;
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void timings_alloc(Timings *t, int n) {
+    t->hold = malloc(n * sizeof(double));
+    t->wait = malloc(n * sizeof(double));
+    if (!t->hold || !t->wait) {
+        perror("malloc");
+        _exit(127);
+    }
+    t->n = 0;
+}
+
+static void timings_free(Timings *t) {
+    free(t->hold);
+    free(t->wait);
+}
+
+static void init_job(Job *job, int id) {
+    job->id = id;
+    job->client_id = id;
+    job->client_fd = -1;
+    job->type = JOB_DEMO;
+    job->initial_burst = job->remaining_time = random_burst();
+    job->stdin_fd = -1;
+}
+
+// Builds a queue of n jobs directly (sched_add() would make this quadratic).
+// Returns the last one.
+static Job *fill(Scheduler *s, Job *jobs, int n) {
+    for (int i = 0; i < n; i++) {
+        init_job(&jobs[i], i + 1);
+        jobs[i].arrival_seq = i + 1;
+        jobs[i].next = i + 1 < n ? &jobs[i + 1] : NULL;
+    }
+    s->job_head = &jobs[0];
+    s->arrival_counter = n;
+    return &jobs[n - 1];
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void print_row(int jobs, int submitters, const char *op, Timings *t) {
+    int n = t->n;
+    if (n == 0) return;
+    double hold_sum = 0, wait_sum = 0;
+    for (int i = 0; i < n; i++) {
+        hold_sum += t->hold[i];
+        wait_sum += t->wait[i];
+    }
+    qsort(t->hold, n, sizeof(double), cmp_double);
+    qsort(t->wait, n, sizeof(double), cmp_double);
+    int p50 = n / 2, p99 = (int)(n * 0.99);
+    if (p99 >= n) p99 = n - 1;
+    printf("%d,%d,%s,%d,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f\n", jobs, submitters, op, n,
+           hold_sum / n, t->hold[p50], t->hold[p99], t->hold[n - 1],
+           wait_sum / n, t->wait[p99], t->wait[n - 1]);
+    fflush(stdout);
+}
+
+// One decision as the scheduler thread makes it: pick a job, check for
+// preemption as after a tick, run a quantum's worth of it and requeue it at the
+// front (a finished job is recycled with a new burst, keeping the depth)
+static void decide(Scheduler *s, Timings *decision, Timings *preempt, int requeue) {
+    double t0 = now_ns();
+    pthread_mutex_lock(&s->lock);
+    double t1 = now_ns();
+    Job *job = sched_next(s);
+    double t2 = now_ns();
+    pthread_mutex_unlock(&s->lock);
+    decision->wait[decision->n] = t1 - t0;
+    decision->hold[decision->n++] = t2 - t1;
+    if (!job) return;
+
+    t0 = now_ns();
+    pthread_mutex_lock(&s->lock);
+    t1 = now_ns();
+    sched_should_preempt(s, job);
+    t2 = now_ns();
+    pthread_mutex_unlock(&s->lock);
+    preempt->wait[preempt->n] = t1 - t0;
+    preempt->hold[preempt->n++] = t2 - t1;
+
+    if (!requeue) return;
+    int quantum = job->rounds_run++ == 0 ? SCHED_QUANTUM_1 : SCHED_QUANTUM_REST;
+    job->remaining_time -= job->remaining_time < quantum ? job->remaining_time : quantum;
+    if (job->remaining_time == 0) job->initial_burst = job->remaining_time = random_burst();
+    pthread_mutex_lock(&s->lock);
+    job->next = s->job_head;
+    s->job_head = job;
+    s->running = NULL;
+    pthread_mutex_unlock(&s->lock);
+}
+
+static void *submit_loop(void *arg) {
+    Submitter *sub = arg;
+    for (int i = 0; i < sub->count; i++) {
+        double t0 = now_ns();
+        pthread_mutex_lock(&sub->s->lock);
+        double t1 = now_ns();
+        sched_add(sub->s, &sub->jobs[i]);
+        double t2 = now_ns();
+        pthread_cond_signal(&sub->s->cond);
+        pthread_mutex_unlock(&sub->s->lock);
+        sub->t.wait[sub->t.n] = t1 - t0;
+        sub->t.hold[sub->t.n++] = t2 - t1;
+    }
+    return NULL;
+}
+
+// Single-threaded: every operation at a steady depth of n
+static void bench_depth(int n, int samples) {
+    Scheduler s;
+    sched_init(&s, NULL);
+    Job *jobs = calloc(n + 1, sizeof(Job));
+    if (!jobs) {
+        perror("calloc");
+        exit(1);
+    }
+    Job *tail = fill(&s, jobs, n);
+    Timings enq, dec, pre;
+    timings_alloc(&enq, samples);
+    timings_alloc(&dec, samples);
+    timings_alloc(&pre, samples);
+
+    // Enqueue one extra job at the tail, then unlink it again
+    Job *extra = &jobs[n];
+    for (int i = 0; i < samples; i++) {
+        init_job(extra, n + 1);
+        double t0 = now_ns();
+        pthread_mutex_lock(&s.lock);
+        double t1 = now_ns();
+        sched_add(&s, extra);
+        double t2 = now_ns();
+        tail->next = NULL;
+        pthread_mutex_unlock(&s.lock);
+        enq.wait[enq.n] = t1 - t0;
+        enq.hold[enq.n++] = t2 - t1;
+    }
+    for (int i = 0; i < samples; i++) decide(&s, &dec, &pre, 1);
+
+    print_row(n, 0, "enqueue", &enq);
+    print_row(n, 0, "decision", &dec);
+    print_row(n, 0, "preempt_check", &pre);
+    timings_free(&enq);
+    timings_free(&dec);
+    timings_free(&pre);
+    free(jobs);
+}
+
+// Submitters enqueue samples jobs each while this thread makes as many
+// decisions, each retiring its job, so the depth hovers around n
+static void bench_depth_mt(int n, int samples, int nsub) {
+    Scheduler s;
+    sched_init(&s, NULL);
+    size_t total = (size_t)n + (size_t)nsub * samples;
+    Job *jobs = calloc(total, sizeof(Job));
+    Submitter *subs = calloc(nsub, sizeof(Submitter));
+    pthread_t *tids = calloc(nsub, sizeof(pthread_t));
+    if (!jobs || !subs || !tids) {
+        perror("calloc");
+        exit(1);
+    }
+    fill(&s, jobs, n);
+    for (int i = 0; i < nsub; i++) {
+        subs[i].s = &s;
+        subs[i].jobs = jobs + n + (size_t)i * samples;
+        subs[i].count = samples;
+        for (int j = 0; j < samples; j++) init_job(&subs[i].jobs[j], n + i * samples + j + 1);
+        timings_alloc(&subs[i].t, samples);
+    }
+    Timings dec, pre;
+    timings_alloc(&dec, nsub * samples);
+    timings_alloc(&pre, nsub * samples);
+
+    for (int i = 0; i < nsub; i++) pthread_create(&tids[i], NULL, submit_loop, &subs[i]);
+    for (int i = 0; i < nsub * samples; i++) decide(&s, &dec, &pre, 0);
+
+    Timings enq;
+    timings_alloc(&enq, nsub * samples);
+    for (int i = 0; i < nsub; i++) {
+        pthread_join(tids[i], NULL);
+        memcpy(enq.hold + enq.n, subs[i].t.hold, subs[i].t.n * sizeof(double));
+        memcpy(enq.wait + enq.n, subs[i].t.wait, subs[i].t.n * sizeof(double));
+        enq.n += subs[i].t.n;
+        timings_free(&subs[i].t);
+    }
+    print_row(n, nsub, "enqueue", &enq);
+    print_row(n, nsub, "decision", &dec);
+    print_row(n, nsub, "preempt_check", &pre);
+    timings_free(&enq);
+    timings_free(&dec);
+    timings_free(&pre);
+    free(tids);
+    free(subs);
+    free(jobs);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-n depth,...] [-r samples] [-t submitters] [-s seed]\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    char *depths = "1000,10000,100000,1000000";
+    int samples = 0, nsub = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:r:t:s:")) != -1) {
+        switch (opt) {
+            case 'n': depths = optarg; break;
+            case 'r': samples = atoi(optarg); break;   // Default: fewer at larger depths
+            case 't': nsub = atoi(optarg); break;
+            case 's': g_rng = strtoull(optarg, NULL, 10) | 1; break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (samples < 0 || nsub < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // A Job carries its result, capture and list state inline, so deep queues
+    // need a lot of memory; depths that would not fit are skipped
+    double avail = (double)sysconf(_SC_AVPHYS_PAGES) * sysconf(_SC_PAGESIZE);
+    printf("jobs,submitters,op,samples,hold_mean_ns,hold_p50_ns,hold_p99_ns,hold_max_ns,wait_mean_ns,wait_p99_ns,wait_max_ns\n");
+    char *list = strdup(depths), *save = NULL;
+    if (!list) {
+        perror("strdup");
+        return 1;
+    }
+    for (char *tok = strtok_r(list, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        int n = atoi(tok);
+        if (n < 1) continue;
+        // About 2*10^7 queue nodes visited per operation type
+        int k = samples ? samples : n >= 20000000 ? 20 : 20000000 / n;
+        if (k < 20) k = 20;
+        if (k > 1000) k = 1000;
+        double need = ((double)n + (double)nsub * k + 1) * sizeof(Job);
+        if (need > avail * 0.8) {
+            fprintf(stderr, "schedbench: skipping %d jobs: needs %.0f MB (%zu bytes per Job), %.0f MB available\n",
+                    n, need / 1048576, sizeof(Job), avail / 1048576);
+            continue;
+        }
+        if (nsub > 0) bench_depth_mt(n, k, nsub);
+        else bench_depth(n, k);
+    }
+    free(list);
+    return 0;
+}
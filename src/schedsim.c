@@ -0,0 +1,202 @@
+#define _GNU_SOURCE
+#include "scheduler.h"
+#include "trace.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <getopt.h>
+#include <time.h>
+
+// Replays an arrival trace (server -T) through the server's own scheduler
+// (scheduler.c: select_job(), quanta, preemption checks) on a virtual clock: a demo
+// tick advances the clock instead of sleeping, and arrivals are delivered as the
+// clock passes them, so a minute of scheduling takes milliseconds. Prints the
+// server's event log (-v), its P<id>-(t) timeline, and per-job latencies.
+
+typedef struct {
+    int client_id, burst;
+    double arrival_ms, start_ms, end_ms;    // start_ms < 0 until the job first runs
+} JobStats;
+
+typedef struct {
+    Scheduler sched;
+    TraceEvent *ev;
+    int nev, next;              // Events delivered so far
+    double now;                 // Virtual time, ms
+    double log_ms;              // Time stamped on log lines: now, or an arrival being queued
+    double tick_ms;             // Length of one demo tick
+    JobStats *stats;            // By job id - 1
+    int njobs;
+} Sim;
+
+static Sim g_sim;
+static int g_verbose;
+
+// The server's event log, stamped with virtual time
+static void sim_log(const char *fmt, ...) {
+    if (!g_verbose) return;
+    va_list args;
+    va_start(args, fmt);
+    printf("[%10.1f] ", g_sim.log_ms);
+    vprintf(fmt, args);
+    va_end(args);
+}
+
+// Queues every trace event due by now, as the server's client threads would
+static void deliver(Sim *sim) {
+    while (sim->next < sim->nev && sim->ev[sim->next].t_ms <= sim->now) {
+        const TraceEvent *e = &sim->ev[sim->next++];
+        Job *job = calloc(1, sizeof(Job));
+        if (!job) {
+            perror("calloc");
+            exit(1);
+        }
+        job->id = ++sim->njobs;
+        job->client_id = e->client_id;
+        job->client_fd = -1;
+        job->command = xstrdup(e->command);
+        job->type = e->burst < 0 ? JOB_CMD : JOB_DEMO;
+        job->initial_burst = e->burst;
+        job->remaining_time = e->burst < 0 ? 0 : e->burst;
+        job->stdin_fd = -1;
+        sim->stats[job->id - 1] = (JobStats){ e->client_id, e->burst, e->t_ms, -1, -1 };
+
+        sim->log_ms = e->t_ms;
+        pthread_mutex_lock(&sim->sched.lock);
+        if (job->type == JOB_CMD) sched_add_shell(&sim->sched, job);
+        else sched_add(&sim->sched, job);
+        pthread_mutex_unlock(&sim->sched.lock);
+    }
+    sim->log_ms = sim->now;
+}
+
+// A tick of demo work: time passes and whatever arrived meanwhile is queued
+static void sim_tick(void *ctx, Job *job) {
+    Sim *sim = ctx;
+    (void)job;
+    sim->now += sim->tick_ms;
+    sim->log_ms = sim->now;
+    deliver(sim);
+}
+
+static void finish(Sim *sim, Job *job) {
+    sim->stats[job->id - 1].end_ms = sim->now;
+    sim_log("(%d) --- ended (%d)\n", job->client_id, job->type == JOB_CMD ? -1 : job->remaining_time);
+    free(job->command);
+    free(job);
+}
+
+// The scheduler loop of server.c, with the clock jumping over idle time
+static void run(Sim *sim) {
+    Scheduler *s = &sim->sched;
+    while (1) {
+        deliver(sim);
+        pthread_mutex_lock(&s->lock);
+        if (!s->shell_head && !s->job_head) {
+            sched_print_timeline(s, stdout);
+            pthread_mutex_unlock(&s->lock);
+            if (sim->next == sim->nev) break;
+            sim->now = sim->log_ms = sim->ev[sim->next].t_ms;
+            continue;
+        }
+        Job *job = sched_next(s);
+        pthread_mutex_unlock(&s->lock);
+        if (!job) continue;
+
+        JobStats *st = &sim->stats[job->id - 1];
+        if (st->start_ms < 0) st->start_ms = sim->now;
+        if (job->type == JOB_CMD) {
+            // Shell jobs execute instantly for timeline purposes
+            sim_log("(%d) --- started (-1)\n", job->client_id);
+            finish(sim, job);
+        } else if (!sched_after_run(s, job, sched_run_quantum(s, job, sim_tick, sim))) {
+            finish(sim, job);
+        }
+    }
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Prints key=value latency summaries of the demo jobs
+static void report(const Sim *sim, int per_job, double wall_ms) {
+    double *turnaround = malloc((sim->njobs + 1) * sizeof(double));
+    double *response = malloc((sim->njobs + 1) * sizeof(double));
+    if (!turnaround || !response) {
+        perror("malloc");
+        exit(1);
+    }
+    int n = 0;
+    double sum_t = 0, sum_r = 0, sum_w = 0, makespan = 0;
+    for (int i = 0; i < sim->njobs; i++) {
+        const JobStats *st = &sim->stats[i];
+        if (st->end_ms > makespan) makespan = st->end_ms;
+        if (per_job) {
+            printf("job=%d client=%d burst=%d arrival_ms=%.1f start_ms=%.1f end_ms=%.1f turnaround_ms=%.1f\n",
+                   i + 1, st->client_id, st->burst, st->arrival_ms, st->start_ms, st->end_ms,
+                   st->end_ms - st->arrival_ms);
+        }
+        if (st->burst < 0 || st->end_ms < 0) continue;
+        turnaround[n] = st->end_ms - st->arrival_ms;
+        response[n] = st->start_ms - st->arrival_ms;
+        sum_t += turnaround[n];
+        sum_r += response[n];
+        sum_w += turnaround[n] - st->burst * sim->tick_ms;
+        n++;
+    }
+    qsort(turnaround, n, sizeof(double), cmp_double);
+    qsort(response, n, sizeof(double), cmp_double);
+    printf("schedsim events=%d jobs=%d demo_jobs=%d preemptions=%d tick_ms=%.1f makespan_ms=%.1f"
+           " turnaround_mean_ms=%.1f turnaround_p50_ms=%.1f turnaround_max_ms=%.1f"
+           " response_mean_ms=%.1f response_max_ms=%.1f wait_mean_ms=%.1f wall_ms=%.3f\n",
+           sim->nev, sim->njobs, n, sim->sched.preemptions, sim->tick_ms, makespan,
+           n ? sum_t / n : 0, n ? turnaround[n / 2] : 0, n ? turnaround[n - 1] : 0,
+           n ? sum_r / n : 0, n ? response[n - 1] : 0, n ? sum_w / n : 0, wall_ms);
+    free(turnaround);
+    free(response);
+}
+
+int main(int argc, char *argv[]) {
+    double tick_ms = 1000;
+    int per_job = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "k:jv")) != -1) {
+        switch (opt) {
+            case 'k': tick_ms = atof(optarg); break;   // The server's demo tick is sleep(1)
+            case 'j': per_job = 1; break;
+            case 'v': g_verbose = 1; break;
+            default:
+                fprintf(stderr, "Usage: %s [-k tick_ms] [-j] [-v] trace.jsonl\n", argv[0]);
+                return 1;
+        }
+    }
+    if (optind != argc - 1 || tick_ms <= 0) {
+        fprintf(stderr, "Usage: %s [-k tick_ms] [-j] [-v] trace.jsonl\n", argv[0]);
+        return 1;
+    }
+
+    Sim *sim = &g_sim;
+    sim->nev = trace_load(argv[optind], &sim->ev);
+    if (sim->nev < 0) return 1;
+    sim->tick_ms = tick_ms;
+    sim->stats = calloc(sim->nev + 1, sizeof(JobStats));
+    if (!sim->stats) {
+        perror("calloc");
+        return 1;
+    }
+    sched_init(&sim->sched, sim_log);
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    run(sim);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    report(sim, per_job, (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6);
+    trace_free(sim->ev, sim->nev);
+    free(sim->stats);
+    return 0;
+}
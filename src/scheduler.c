@@ -0,0 +1,317 @@
+#define _GNU_SOURCE
+#include "scheduler.h"
+#include <stdlib.h>
+#include <string.h>
+
+void sched_init(Scheduler *s, void (*log)(const char *fmt, ...)) {
+    memset(s, 0, sizeof(*s));
+    s->last_job_id = -1;
+    s->log = log;
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->cond, NULL);
+}
+
+static void append(Job **head, Job *job) {
+    // Add to end of queue
+    if (!*head) {
+        *head = job;
+    } else {
+        Job *curr = *head;
+        while (curr->next) curr = curr->next;
+        curr->next = job;
+    }
+}
+
+void sched_add_shell(Scheduler *s, Job *job) {
+    job->arrival_seq = ++s->arrival_counter;  // Track arrival order
+    job->next = NULL;
+    append(&s->shell_head, job);
+    if (s->log) s->log("(%d) --- created (%d)\n", job->client_id, job->initial_burst);
+}
+
+void sched_add(Scheduler *s, Job *job) {
+    job->arrival_seq = ++s->arrival_counter;
+    job->next = NULL;
+    append(&s->job_head, job);
+    if (s->log) s->log("(%d) --- created (%d)\n", job->client_id, job->initial_burst);
+}
+
+Job *select_job(Scheduler *s, int remove, Job *exclude, int last_job_id) {
+    if (!s->job_head) return NULL;
+
+    // First pass: Find shortest remaining time among non-excluded demo jobs
+    int shortest_time = -1;
+    Job *curr = s->job_head;
+    while (curr) {
+        if (curr != exclude && curr->initial_burst != -1) {
+            if (shortest_time == -1 || curr->remaining_time < shortest_time) {
+                shortest_time = curr->remaining_time;
+            }
+        }
+        curr = curr->next;
+    }
+    
+    // Second pass: Select best job according to priority rules
+    curr = s->job_head;
+    Job *curr_prev = NULL;
+    Job *best = NULL;
+    Job *best_prev = NULL;
+    Job *alternate_best = NULL;  // Alternative if best matches last_job_id
+    Job *alternate_best_prev = NULL;
+    
+    while (curr) {
+        if (curr == exclude) {
+            curr_prev = curr;
+            curr = curr->next;
+            continue;
+        }
+        
+        // Priority 1: Shell Commands (burst == -1) always selected first
+        if (curr->initial_burst == -1) {
+            if (!best || best->initial_burst != -1) {
+                best = curr;
+                best_prev = curr_prev;
+            }
+        }
+        // Priority 2: Jobs with shortest remaining time (SJRF)
+        else if (shortest_time >= 0 && curr->remaining_time == shortest_time) {
+            // Check if this is a candidate for selection
+            if (!best || best->initial_burst == -1 || 
+                (best->initial_burst != -1 && best->remaining_time > shortest_time)) {
+                // This job is better than current best
+                if (last_job_id >= 0 && curr->id == last_job_id) {
+                    // This matches last job - save as alternate, but look for different one
+                    if (!alternate_best) {
+                        alternate_best = curr;
+                        alternate_best_prev = curr_prev;
+                    }
+                } else {
+                    // This is different from last job - prefer it
+                    best = curr;
+                    best_prev = curr_prev;
+                }
+            } else if (best && best->initial_burst != -1 && 
+                       best->remaining_time == shortest_time &&
+                       last_job_id >= 0 && best->id == last_job_id &&
+                       curr->id != last_job_id) {
+                // Current best matches last_job_id, but this one doesn't - prefer this
+                best = curr;
+                best_prev = curr_prev;
+            }
+        }
+        
+        curr_prev = curr;
+        curr = curr->next;
+    }
+    
+    // If best matches last_job_id, check if we have alternate options
+    if (best && last_job_id >= 0 && best->id == last_job_id) {
+        // Check if there are other jobs with same shortest time
+        curr = s->job_head;
+        int other_options = 0;
+        while (curr) {
+            if (curr != exclude && curr != best &&
+                curr->initial_burst != -1 && 
+                curr->remaining_time == shortest_time &&
+                curr->id != last_job_id) {
+                other_options = 1;
+                break;
+            }
+            curr = curr->next;
+        }
+        
+        // If other options exist, we should have found them above
+        // But if we only have alternate_best, use it only if no other options
+        if (!other_options && alternate_best && alternate_best->id == last_job_id) {
+            // Only option is the same job - must select it (rule exception)
+            best = alternate_best;
+            best_prev = alternate_best_prev;
+        } else if (other_options) {
+            // There are other options - we should have selected one above
+            // This shouldn't happen, but if it does, keep current best
+        }
+    }
+
+    // Fallback: If best is still NULL, we need to pick ANY runnable job
+    // This prevents returning NULL when jobs exist in the queue
+    if (!best) {
+        // Try to find any job that doesn't match last_job_id
+        curr = s->job_head;
+        curr_prev = NULL;
+        while (curr) {
+            if (curr != exclude && (last_job_id < 0 || curr->id != last_job_id)) {
+                best = curr;
+                best_prev = curr_prev;
+                break;
+            }
+            curr_prev = curr;
+            curr = curr->next;
+        }
+        
+        // If still NULL, just pick the first non-excluded job (even if it matches last_job_id)
+        if (!best) {
+            curr = s->job_head;
+            curr_prev = NULL;
+            while (curr) {
+                if (curr != exclude) {
+                    best = curr;
+                    best_prev = curr_prev;
+                    break;
+                }
+                curr_prev = curr;
+                curr = curr->next;
+            }
+        }
+    }
+
+    if (!best) return NULL;  // No valid job found (should never happen if queue has jobs)
+
+    if (remove && best) {
+        if (best_prev) {
+            best_prev->next = best->next;
+        } else {
+            s->job_head = best->next;
+        }
+        best->next = NULL;
+    }
+    return best;
+}
+
+Job *sched_next(Scheduler *s) {
+    // Scheduling policy:
+    // 1) Shell commands always have absolute priority - run immediately to completion (FIFO)
+    // 2) Demo/program jobs scheduled using RR+SRJF only when no shell commands pending
+    Job *job = NULL;
+    if (s->shell_head != NULL) {
+        // Shell command available - take from front of shell queue (FIFO)
+        job = s->shell_head;
+        s->shell_head = job->next;
+        job->next = NULL;
+        // Shell jobs don't update last_job_id (they're outside RR rotation)
+    } else {
+        // No shell commands - select from demo/program queue using RR+SRJF
+        job = select_job(s, 1, NULL, s->last_job_id);
+        // Track currently running job for preemption checks
+        s->running = job;
+        if (job) {
+            // Update last_job_id to track which job just ran (for fairness)
+            s->last_job_id = job->id;
+        }
+    }
+    // Mark the arrival epoch when this job starts its current run
+    // Any job with arrival_seq > run_epoch_seq arrived "during" this run
+    if (job) job->run_epoch_seq = s->arrival_counter;
+    return job;
+}
+
+int sched_should_preempt(const Scheduler *s, const Job *job) {
+    // Shell commands always preempt demo jobs
+    if (s->shell_head != NULL) return 1;
+
+    // Newer demo jobs with strictly shorter remaining burst time (SRJF preemption)
+    // "Newer" means arrived after this job started its current run (arrival_seq > run_epoch_seq)
+    // This implements selectively preemptive SRJF based on remaining burst time
+    for (const Job *curr = s->job_head; curr; curr = curr->next) {
+        if (curr != job &&
+            curr->initial_burst != -1 &&  // Is a demo job
+            curr->arrival_seq > job->run_epoch_seq &&  // Arrived after this run started
+            curr->remaining_time < job->remaining_time) {  // Strictly shorter remaining burst (SRJF)
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Checks for preemption under the lock, counting it if so
+static int check_preempt(Scheduler *s, const Job *job) {
+    pthread_mutex_lock(&s->lock);
+    int preempt = sched_should_preempt(s, job);
+    if (preempt) s->preemptions++;
+    pthread_mutex_unlock(&s->lock);
+    return preempt;
+}
+
+int sched_run_quantum(Scheduler *s, Job *job, void (*tick)(void *ctx, Job *job), void *ctx) {
+    int quantum = (job->rounds_run == 0) ? SCHED_QUANTUM_1 : SCHED_QUANTUM_REST;
+    int time_slice = 0;
+
+    // Logging: first run prints "started", subsequent runs print "running"
+    if (s->log) {
+        if (job->rounds_run == 0) s->log("(%d) --- started (%d)\n", job->client_id, job->remaining_time);
+        else s->log("(%d) --- running (%d)\n", job->client_id, job->remaining_time);
+    }
+
+    // Immediate preemption check: If a higher-priority job arrived between selection and execution,
+    // preempt this job before it does any work (enables 0-second preemption)
+    if (!check_preempt(s, job)) {
+        while (time_slice < quantum && job->remaining_time > 0) {
+            tick(ctx, job);  // Work
+            job->remaining_time--;
+            time_slice++;
+            if (check_preempt(s, job)) break;  // Preempt
+        }
+    }
+
+    job->rounds_run++;
+
+    // Logging: For demo jobs, always use "waiting" when there's remaining time
+    // Never log "preempted" for demo jobs - preemption is implied by waiting before quantum ends
+    if (job->remaining_time > 0 && s->log) {
+        s->log("(%d) --- waiting (%d)\n", job->client_id, job->remaining_time);
+    }
+    // If remaining_time == 0, we don't log here; the caller logs bytes + ended
+    return time_slice;
+}
+
+// Add entry to timeline for final summary
+static void add_timeline_entry(Scheduler *s, int client_id, int elapsed_time) {
+    TimelineEntry *entry = malloc(sizeof(TimelineEntry));
+    if (!entry) return;
+    entry->client_id = client_id;
+    entry->elapsed_time = elapsed_time;
+    entry->next = NULL;
+
+    if (!s->timeline_head) {
+        s->timeline_head = s->timeline_tail = entry;
+    } else {
+        s->timeline_tail->next = entry;
+        s->timeline_tail = entry;
+    }
+}
+
+int sched_after_run(Scheduler *s, Job *job, int ticks) {
+    // Shell jobs execute instantly for timeline purposes, so only demo work advances global time
+    s->global_time += ticks;
+    add_timeline_entry(s, job->client_id, s->global_time);
+
+    pthread_mutex_lock(&s->lock);
+    // Clear running job after execution completes (whether finished or preempted)
+    s->running = NULL;
+    int requeue = job->remaining_time > 0;
+    if (requeue) {
+        job->next = s->job_head;
+        s->job_head = job;
+    }
+    pthread_mutex_unlock(&s->lock);
+    return requeue;
+}
+
+void sched_print_timeline(Scheduler *s, FILE *out) {
+    if (!s->timeline_head) return;
+
+    TimelineEntry *curr = s->timeline_head;
+    fprintf(out, "\n0)-");  // Always start with "0)-"
+    while (curr) {
+        fprintf(out, "P%d-(%d)", curr->client_id, curr->elapsed_time);
+        if (curr->next) fprintf(out, "-");
+        TimelineEntry *next = curr->next;
+        free(curr);
+        curr = next;
+    }
+    fprintf(out, "\n");
+    fflush(out);
+
+    // Reset global time for the next scenario
+    s->timeline_head = s->timeline_tail = NULL;
+    s->global_time = 0;
+}
@@ -1,9 +1,16 @@
+#define _GNU_SOURCE
 #include "net.h"
 #include "parse.h"
 #include "exec.h"
 #include "util.h"
 #include "errors.h"
 #include "job.h"
+#include "capture.h"
+#include "supervisor.h"
+#include "rcache.h"
+#include "session.h"
+#include "scheduler.h"
+#include "trace.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,37 +19,39 @@
 #include <unistd.h>
 #include <pthread.h> 
 #include <stdarg.h> // Required for va_list
-
-#define MAX_CMD_LENGTH 1024 
-#define SCHED_QUANTUM_1 3
-#define SCHED_QUANTUM_REST 7
+#include <getopt.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <ctype.h>
+#include <limits.h>
 
 // Global State
 static int server_fd = -1;
 static volatile sig_atomic_t g_stop = 0;
 static int client_id_counter = 0;
 static int job_id_counter = 0;
-static int g_job_arrival_counter = 0;  // Track arrival sequence for preemption logic
-
-// Scheduler Queues
-// Shell commands are handled separately with absolute priority (immediate execution)
-Job *shell_queue_head = NULL;  // FIFO queue for shell commands (run immediately)
-Job *job_queue_head = NULL;     // RR+SRJF queue for demo/program jobs only
-Job *current_running_job = NULL;  // Track currently running job for preemption checks
-int last_job_id = -1;  // Track last job ID to enforce "no same job twice consecutively" rule
-pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
-
-// Timeline tracking for final summary
-typedef struct TimelineEntry {
-    int client_id;
-    int elapsed_time;  // Changed from remaining_time to elapsed_time for global time tracking
-    struct TimelineEntry *next;
-} TimelineEntry;
-static TimelineEntry *timeline_head = NULL;
-static TimelineEntry *timeline_tail = NULL;
-static int had_preemption = 0;  // Track if any preemption occurred (only print summary if true)
-static int global_time = 0;  // Track global elapsed time for timeline summary
+static size_t g_output_limit = CAPTURE_DEFAULT_LIMIT;  // Per-job cap on captured output (-m)
+static Supervisor g_supervisor;  // Watches every running shell job (pidfds + capture pipes)
+static IsolateConfig g_isolate;  // Per-job cgroup limits and CPU pinning (-g/-c/-M/-p/-s/-P)
+static ResultCache g_rcache;     // Output of commands declared pure (-r), kept for -t ms
+static PlanCache g_plans;        // Parsed pipelines by exact text (-L entries)
+static Job *g_inflight_head = NULL;  // Queued or running cacheable jobs that new duplicates can join
+static pthread_mutex_t g_inflight_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int g_sessions = 0;       // Each connection keeps its own cwd and environment (-S)
+static int g_server_cwd = -1;    // Scheduler thread returns here for session-less jobs
+
+// Scheduler queues (see scheduler.h): shell commands are handled separately with
+// absolute priority (immediate execution), demo/program jobs by RR+SRJF
+static Scheduler g_sched;
+static Trace g_trace;            // Arrivals of scheduled jobs, for schedsim (-T file)
+
+// A client's frames come from its own thread (builtins, cache hits), the scheduler
+// thread (demo ticks) and delivery threads (shell results). A frame is a header
+// and a payload send(), so frames to one socket are serialized by its slot's lock;
+// the reply lock keeps a whole response (frames up to <<EOF>>) in one piece.
+#define SEND_LOCK_SLOTS 1024
+static pthread_mutex_t g_send_locks[SEND_LOCK_SLOTS];
+static pthread_mutex_t g_reply_locks[SEND_LOCK_SLOTS];
 
 // Logs
 pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -62,202 +71,57 @@ void handle_sigint(int sig) {
     g_stop = 1;
     if(server_fd >= 0) close(server_fd);
     // Wake up scheduler so it can exit
-    pthread_mutex_lock(&queue_mutex);
-    pthread_cond_broadcast(&queue_cond);
-    pthread_mutex_unlock(&queue_mutex);
+    pthread_mutex_lock(&g_sched.lock);
+    pthread_cond_broadcast(&g_sched.cond);
+    pthread_mutex_unlock(&g_sched.lock);
+    sv_wake(&g_supervisor);
 }
 
 // --- Queue Helpers ---
 
 // Enqueue shell command to immediate-execution queue (absolute priority, FIFO)
 void add_shell_job(Job *new_job) {
-    pthread_mutex_lock(&queue_mutex);
-    
-    // Add to end of shell queue (FIFO order)
-    if (!shell_queue_head) {
-        shell_queue_head = new_job;
-    } else {
-        Job *curr = shell_queue_head;
-        while (curr->next) curr = curr->next;
-        curr->next = new_job;
-    }
-    
-    safe_log("(%d) --- created (%d)\n", new_job->client_id, new_job->initial_burst);
-    
+    pthread_mutex_lock(&g_sched.lock);
+    sched_add_shell(&g_sched, new_job);
+    // Under the queue lock, so the trace lists jobs in arrival_seq order
+    trace_record(&g_trace, new_job->client_id, new_job->command, new_job->initial_burst);
     // Wake scheduler immediately - shell commands have absolute priority
-    pthread_cond_signal(&queue_cond);
-    pthread_mutex_unlock(&queue_mutex);
+    pthread_cond_signal(&g_sched.cond);
+    pthread_mutex_unlock(&g_sched.lock);
 }
 
 // Enqueue demo/program job to RR+SRJF scheduling queue
 void add_job(Job *new_job) {
-    pthread_mutex_lock(&queue_mutex);
-    
-    // Add to end of job queue
-    if (!job_queue_head) {
-        job_queue_head = new_job;
-    } else {
-        Job *curr = job_queue_head;
-        while (curr->next) curr = curr->next;
-        curr->next = new_job;
-    }
-    
-    safe_log("(%d) --- created (%d)\n", new_job->client_id, new_job->initial_burst);
-    
-    pthread_cond_signal(&queue_cond);
-    pthread_mutex_unlock(&queue_mutex);
+    pthread_mutex_lock(&g_sched.lock);
+    sched_add(&g_sched, new_job);
+    trace_record(&g_trace, new_job->client_id, new_job->command, new_job->initial_burst);
+    pthread_cond_signal(&g_sched.cond);
+    pthread_mutex_unlock(&g_sched.lock);
 }
 
-// SRJF Selection Algorithm with "no same job twice consecutively" rule
-// If exclude is non-NULL, excludes that job from selection (for preemption checks)
-// If last_job_id >= 0, avoids selecting that job ID unless it's the only option
-Job *select_job(int remove, Job *exclude, int last_job_id) {
-    if (!job_queue_head) return NULL;
-
-    // First pass: Find shortest remaining time among non-excluded demo jobs
-    int shortest_time = -1;
-    Job *curr = job_queue_head;
-    while (curr) {
-        if (curr != exclude && curr->initial_burst != -1) {
-            if (shortest_time == -1 || curr->remaining_time < shortest_time) {
-                shortest_time = curr->remaining_time;
-            }
-        }
-        curr = curr->next;
-    }
-    
-    // Second pass: Select best job according to priority rules
-    curr = job_queue_head;
-    Job *curr_prev = NULL;
-    Job *best = NULL;
-    Job *best_prev = NULL;
-    Job *alternate_best = NULL;  // Alternative if best matches last_job_id
-    Job *alternate_best_prev = NULL;
-    
-    while (curr) {
-        if (curr == exclude) {
-            curr_prev = curr;
-            curr = curr->next;
-            continue;
-        }
-        
-        // Priority 1: Shell Commands (burst == -1) always selected first
-        if (curr->initial_burst == -1) {
-            if (!best || best->initial_burst != -1) {
-                best = curr;
-                best_prev = curr_prev;
-            }
-        }
-        // Priority 2: Jobs with shortest remaining time (SJRF)
-        else if (shortest_time >= 0 && curr->remaining_time == shortest_time) {
-            // Check if this is a candidate for selection
-            if (!best || best->initial_burst == -1 || 
-                (best->initial_burst != -1 && best->remaining_time > shortest_time)) {
-                // This job is better than current best
-                if (last_job_id >= 0 && curr->id == last_job_id) {
-                    // This matches last job - save as alternate, but look for different one
-                    if (!alternate_best) {
-                        alternate_best = curr;
-                        alternate_best_prev = curr_prev;
-                    }
-                } else {
-                    // This is different from last job - prefer it
-                    best = curr;
-                    best_prev = curr_prev;
-                }
-            } else if (best && best->initial_burst != -1 && 
-                       best->remaining_time == shortest_time &&
-                       last_job_id >= 0 && best->id == last_job_id &&
-                       curr->id != last_job_id) {
-                // Current best matches last_job_id, but this one doesn't - prefer this
-                best = curr;
-                best_prev = curr_prev;
-            }
-        }
-        
-        curr_prev = curr;
-        curr = curr->next;
-    }
-    
-    // If best matches last_job_id, check if we have alternate options
-    if (best && last_job_id >= 0 && best->id == last_job_id) {
-        // Check if there are other jobs with same shortest time
-        curr = job_queue_head;
-        int other_options = 0;
-        while (curr) {
-            if (curr != exclude && curr != best &&
-                curr->initial_burst != -1 && 
-                curr->remaining_time == shortest_time &&
-                curr->id != last_job_id) {
-                other_options = 1;
-                break;
-            }
-            curr = curr->next;
-        }
-        
-        // If other options exist, we should have found them above
-        // But if we only have alternate_best, use it only if no other options
-        if (!other_options && alternate_best && alternate_best->id == last_job_id) {
-            // Only option is the same job - must select it (rule exception)
-            best = alternate_best;
-            best_prev = alternate_best_prev;
-        } else if (other_options) {
-            // There are other options - we should have selected one above
-            // This shouldn't happen, but if it does, keep current best
-        }
-    }
-
-    // Fallback: If best is still NULL, we need to pick ANY runnable job
-    // This prevents returning NULL when jobs exist in the queue
-    if (!best) {
-        // Try to find any job that doesn't match last_job_id
-        curr = job_queue_head;
-        curr_prev = NULL;
-        while (curr) {
-            if (curr != exclude && (last_job_id < 0 || curr->id != last_job_id)) {
-                best = curr;
-                best_prev = curr_prev;
-                break;
-            }
-            curr_prev = curr;
-            curr = curr->next;
-        }
-        
-        // If still NULL, just pick the first non-excluded job (even if it matches last_job_id)
-        if (!best) {
-            curr = job_queue_head;
-            curr_prev = NULL;
-            while (curr) {
-                if (curr != exclude) {
-                    best = curr;
-                    best_prev = curr_prev;
-                    break;
-                }
-                curr_prev = curr;
-                curr = curr->next;
-            }
-        }
-    }
-
-    if (!best) return NULL;  // No valid job found (should never happen if queue has jobs)
+// --- Execution Logic ---
 
-    if (remove && best) {
-        if (best_prev) {
-            best_prev->next = best->next;
-        } else {
-            job_queue_head = best->next;
-        }
-        best->next = NULL;
-    }
-    return best;
+// send_frame() and send_frame_file() under the socket's send lock
+static int client_send_frame(int client_fd, int type, const char *data, size_t len) {
+    pthread_mutex_t *lock = &g_send_locks[client_fd % SEND_LOCK_SLOTS];
+    pthread_mutex_lock(lock);
+    int rc = send_frame(client_fd, type, data, len);
+    pthread_mutex_unlock(lock);
+    return rc;
 }
 
-// --- Execution Logic ---
+static int client_send_frame_file(int client_fd, int type, int file_fd, off_t offset, size_t len) {
+    pthread_mutex_t *lock = &g_send_locks[client_fd % SEND_LOCK_SLOTS];
+    pthread_mutex_lock(lock);
+    int rc = send_frame_file(client_fd, type, file_fd, offset, len);
+    pthread_mutex_unlock(lock);
+    return rc;
+}
 
 // Safe send that handles client disconnects gracefully
 static int safe_send_line(int client_fd, const char *line) {
     if (client_fd < 0) return -1;
-    int result = send_line(client_fd, line);
+    int result = client_send_frame(client_fd, FRAME_LINE, line, strlen(line));
     // If send fails, client likely disconnected - don't crash
     if (result < 0) {
         // Client disconnected, but continue execution for logging
@@ -265,303 +129,463 @@ static int safe_send_line(int client_fd, const char *line) {
     return result;
 }
 
-void run_shell_job(Job *job) {
-    safe_log("(%d) --- started (-1)\n", job->client_id);
-    
-    char *output = execute_pipeline(job->command, job->client_fd);
-    
+// Streams a capture to the client as frames of the given type. Output that spilled
+// to a memfd goes socket-ward with sendfile(), never passing through userspace.
+static void send_capture(int client_fd, int type, const Capture *c) {
+    if (client_fd < 0) return;
+    for (size_t off = 0; off < c->len; ) {
+        size_t n = c->len - off;
+        if (n > FRAME_DATA_CHUNK) n = FRAME_DATA_CHUNK;
+        int rc;
+        if (c->spill_fd >= 0) {
+            rc = client_send_frame_file(client_fd, type, c->spill_fd, off, n);
+        } else {
+            rc = client_send_frame(client_fd, type, c->mem + off, n);
+        }
+        if (rc < 0) return;  // Client disconnected
+        off += n;
+    }
+}
+
+// Sends the structured result (exit codes, syntax error codes) ahead of <<EOF>>
+static void send_status(int client_fd, const ExecResult *res) {
+    if (client_fd < 0) return;
+    char buf[512];
+    int len = snprintf(buf, sizeof(buf), "exit=%d stages=", res->exit_status);
+    for (int i = 0; i < res->nstages && len < (int)sizeof(buf) - 16; i++) {
+        len += snprintf(buf + len, sizeof(buf) - len, "%s%d", i ? "," : "", res->stages[i].status);
+    }
+    len += snprintf(buf + len, sizeof(buf) - len, " parse=%d validate=%d", res->parse_err, res->validate_err);
+    client_send_frame(client_fd, FRAME_STATUS, buf, len);
+}
+
+// Reports wait4() accounting for every stage to the client (FRAME_STATS) and the log
+static void report_stage_stats(const Job *job, const ExecResult *res) {
+    for (int i = 0; i < res->nstages; i++) {
+        if (res->stages[i].pid < 0) continue;  // Never started
+        char stats[256];
+        int len = snprintf(stats, sizeof(stats), "stage=%d ", i);
+        len += exec_format_stage_stats(&res->stages[i], stats + len, sizeof(stats) - len);
+        safe_log("[%d] <<< %s\n", job->client_id, stats);
+        if (job->client_fd >= 0) client_send_frame(job->client_fd, FRAME_STATS, stats, strlen(stats));
+    }
+}
+
+// Single-flight: if an identical cacheable command is already queued or running,
+// attaches job to it and returns 1; otherwise registers job as the one to run.
+static int join_inflight(Job *job) {
+    pthread_mutex_lock(&g_inflight_mutex);
+    for (Job *leader = g_inflight_head; leader; leader = leader->inflight_next) {
+        if (leader->cache_key_len != job->cache_key_len ||
+            memcmp(leader->cache_key, job->cache_key, job->cache_key_len) != 0) continue;
+        Job **tail = &leader->followers;
+        while (*tail) tail = &(*tail)->next;
+        *tail = job;
+        free(job->cache_key);  // The leader stores the shared result
+        job->cache_key = NULL;
+        pthread_mutex_unlock(&g_inflight_mutex);
+        safe_log("(%d) --- coalesced with (%d)\n", job->client_id, leader->client_id);
+        return 1;
+    }
+    job->inflight_next = g_inflight_head;
+    g_inflight_head = job;
+    pthread_mutex_unlock(&g_inflight_mutex);
+    return 0;
+}
+
+// Unregisters a finished leader so later duplicates run afresh, and hands back
+// the followers that joined it.
+static Job *leave_inflight(Job *job) {
+    pthread_mutex_lock(&g_inflight_mutex);
+    for (Job **link = &g_inflight_head; *link; link = &(*link)->inflight_next) {
+        if (*link == job) {
+            *link = job->inflight_next;
+            break;
+        }
+    }
+    Job *followers = job->followers;
+    job->followers = NULL;
+    pthread_mutex_unlock(&g_inflight_mutex);
+    return followers;
+}
+
+// Ships a finished result to the client that asked for it
+static void deliver_shell_result(Job *job, const ExecResult *res) {
+    pthread_mutex_t *reply = &g_reply_locks[job->client_fd % SEND_LOCK_SLOTS];
+    pthread_mutex_lock(reply);
     // Track bytes sent for shell output
-    if(output && strlen(output) > 0) {
-        job->bytes_sent += strlen(output);
+    job->bytes_sent += res->out.len + res->err.len;
+    if (res->out.truncated || res->err.truncated) {
+        safe_log("[%d] <<< output truncated at %zu bytes\n", job->client_id, g_output_limit);
     }
     
-    safe_send_line(job->client_fd, output ? output : "");
-    if(output) free(output);
+    send_capture(job->client_fd, FRAME_DATA, &res->out);
+    send_capture(job->client_fd, FRAME_STDERR, &res->err);
+    send_status(job->client_fd, res);
+    report_stage_stats(job, res);
     
     // Log bytes summary before ended
     if(job->bytes_sent > 0) {
-        safe_log("[%d] <<< %d bytes sent\n", job->client_id, job->bytes_sent);
+        safe_log("[%d] <<< %zu bytes sent\n", job->client_id, job->bytes_sent);
     }
     safe_log("(%d) --- ended (-1)\n", job->client_id);
+    safe_send_line(job->client_fd, "<<EOF>>");
+    pthread_mutex_unlock(reply);
 }
 
-void run_demo_job(Job *job) {
-    int quantum = (job->rounds_run == 0) ? SCHED_QUANTUM_1 : SCHED_QUANTUM_REST; 
-    int time_slice = 0;
-    int was_preempted = 0;  // Track if this job was preempted
-
-    // Logging: first run prints "started", subsequent runs print "running"
-    if (job->rounds_run == 0) {
-        safe_log("(%d) --- started (%d)\n", job->client_id, job->remaining_time);
-    } else {
-        safe_log("(%d) --- running (%d)\n", job->client_id, job->remaining_time);
-    }
-
-    // Immediate preemption check: If a higher-priority job arrived between selection and execution,
-    // preempt this job before it does any work (enables 0-second preemption)
-    pthread_mutex_lock(&queue_mutex);
+// Sends a finished shell job's result to its client and to the duplicates that
+// joined it (job->followers), then frees them all. Runs on a thread of its own:
+// the sends block for as long as the client takes to read, and the supervisor
+// must keep draining and reaping everyone else's jobs meanwhile.
+static void *deliver_shell_job(void *arg) {
+    Job *job = arg;
+    ExecResult *res = &job->result;
     
-    // Check for shell commands (absolute priority)
-    if (shell_queue_head != NULL) {
-        was_preempted = 1;
-        had_preemption = 1;
-        pthread_mutex_unlock(&queue_mutex);
-        job->rounds_run++;
-        if (job->remaining_time > 0) {
-            safe_log("(%d) --- waiting (%d)\n", job->client_id, job->remaining_time);
-        }
-        return;  // Preempt immediately without doing any work
+    deliver_shell_result(job, res);
+    while (job->followers) {
+        Job *f = job->followers;
+        job->followers = f->next;
+        deliver_shell_result(f, res);
+        free(f->command);
+        free(f);
     }
     
-    // Check for newer demo jobs with strictly shorter remaining time
-    Job *curr = job_queue_head;
-    int found_newer_shorter = 0;
-    while (curr) {
-        if (curr != job && 
-            curr->initial_burst != -1 &&
-            curr->arrival_seq > job->run_epoch_seq &&
-            curr->remaining_time < job->remaining_time) {
-            found_newer_shorter = 1;
-            break;
+    exec_result_free(res);
+    session_release(job->session);
+    free(job->command);
+    free(job);
+    return NULL;
+}
+
+// Starts the next pipeline of the job's command list that the last exit status
+// calls for (a lone pipeline is a list of one). Session builtins in the list are
+// applied on the spot. Returns 0 once exec_job_start() was called (finish it via
+// the supervisor even if it failed), -1 when the list is done.
+static int launch_next_pipeline(Job *job) {
+    const char *text;
+    while ((text = list_next(&job->list, &job->list_pos, job->result.exit_status)) != NULL) {
+        if (job->session && session_builtin(job->session, text, &job->result)) continue;
+
+        ExecAttr attr = {
+            .child_setup = isolate_enabled(&g_isolate) ? isolate_child : NULL,
+            .arg = &job->iso,
+            .stdin_fd = job->stdin_fd,
+            .plans = &g_plans,
+        };
+        if (job->session) {
+            // This thread has a private cwd (see enter_private_cwd), so relative paths
+            // and globs resolve against the session while parsing and in the children
+            Session *s = job->session;
+            pthread_mutex_lock(&s->lock);
+            if (chdir(s->cwd) < 0) perror(s->cwd);
+            attr.envp = s->env;
+            attr.resolve = session_resolve;
+            attr.resolve_ctx = s;
+            exec_job_start(text, &job->result, &job->exec, &attr);
+            pthread_mutex_unlock(&s->lock);
+        } else {
+            if (g_server_cwd >= 0 && fchdir(g_server_cwd) < 0) perror("fchdir");
+            exec_job_start(text, &job->result, &job->exec, &attr);
         }
-        curr = curr->next;
+        return 0;
     }
+    return -1;
+}
+
+// Completion callback, on the supervisor thread: the pipeline has exited and its
+// output is fully captured. Moves on to the next pipeline of a command list, or
+// ships everything (to coalesced duplicates too) and retires the job.
+static void finish_shell_job(ExecJob *exec, void *arg) {
+    Job *job = arg;
+    ExecResult *res = exec->res;
+    pthread_t tid;
     
-    if (found_newer_shorter) {
-        was_preempted = 1;
-        had_preemption = 1;
-        pthread_mutex_unlock(&queue_mutex);
-        job->rounds_run++;
-        if (job->remaining_time > 0) {
-            safe_log("(%d) --- waiting (%d)\n", job->client_id, job->remaining_time);
-        }
-        return;  // Preempt immediately without doing any work
+    if (launch_next_pipeline(job) == 0) {
+        sv_add(&g_supervisor, &job->exec, finish_shell_job, job);
+        return;
     }
+    // The whole list shared the upload; once it is closed the uploader sees EPIPE
+    if (job->stdin_fd >= 0) {
+        close(job->stdin_fd);
+        job->stdin_fd = -1;
+    }
+    arena_destroy(&job->list_arena);
+    capture_finish(&res->out);
+    capture_finish(&res->err);
     
-    pthread_mutex_unlock(&queue_mutex);
-
-    while (time_slice < quantum && job->remaining_time > 0) {
-        sleep(1); // Simulate work
-        
-        int current_progress = job->initial_burst - job->remaining_time;
-        char buf[64];
-        snprintf(buf, sizeof(buf), "Demo %d/%d", current_progress, job->initial_burst);
-        safe_send_line(job->client_fd, buf);
-        
-        // Track bytes sent (each Demo line)
-        job->bytes_sent += strlen(buf);
-
-        job->remaining_time--;
-        time_slice++;
-
-        // Preemption Check: Shell commands and newer shorter demo jobs can preempt
-        pthread_mutex_lock(&queue_mutex);
-        
-        // Check for shell commands first (always preempt demo jobs)
-        if (shell_queue_head != NULL) {
-            // Shell command arrived - preempt current demo job immediately
-            was_preempted = 1;
-            had_preemption = 1;  // Mark that preemption occurred
-            pthread_mutex_unlock(&queue_mutex);
-            break; // Preempt
-        }
-        
-        // Check for newer demo jobs with strictly shorter remaining burst time (SRJF preemption)
-        // "Newer" means arrived after this job started its current run (arrival_seq > run_epoch_seq)
-        // This implements selectively preemptive SRJF based on remaining burst time
-        Job *curr = job_queue_head;
-        int found_newer_shorter = 0;
-        while (curr) {
-            if (curr != job && 
-                curr->initial_burst != -1 &&  // Is a demo job
-                curr->arrival_seq > job->run_epoch_seq &&  // Arrived after this run started
-                curr->remaining_time < job->remaining_time) {  // Strictly shorter remaining burst (SRJF)
-                found_newer_shorter = 1;
-                break;
-            }
-            curr = curr->next;
-        }
-        
-        if (found_newer_shorter) {
-            // Newer shorter job arrived - preempt current job
-            was_preempted = 1;
-            had_preemption = 1;
-            pthread_mutex_unlock(&queue_mutex);
-            break; // Preempt
-        }
-        
-        pthread_mutex_unlock(&queue_mutex);
+    isolate_job_end(&job->iso);
+    
+    if (job->cache_key) {
+        // No one joins from here on; the job ships to those who already did
+        job->followers = leave_inflight(job);
+        rcache_store(&g_rcache, job->cache_key, job->cache_key_len, res);
+        free(job->cache_key);
+        job->cache_key = NULL;
     }
-
-    job->rounds_run++;
-
-    // Logging: For demo jobs, always use "waiting" when there's remaining time
-    // Never log "preempted" for demo jobs - preemption is implied by waiting before quantum ends
-    if (job->remaining_time > 0) {
-        safe_log("(%d) --- waiting (%d)\n", job->client_id, job->remaining_time);
+    if (pthread_create(&tid, NULL, deliver_shell_job, job) != 0) {
+        perror("pthread_create");
+        deliver_shell_job(job);
+        return;
     }
-    // If remaining_time == 0, we don't log here; scheduler_loop will log bytes + ended
+    pthread_detach(tid);
+}
+
+// With sessions (-S), gives the calling thread (one that launches shell jobs) its
+// own cwd so it can enter each session's directory without moving the rest of
+// the server
+static void enter_private_cwd(void) {
+    if (g_sessions && unshare(CLONE_FS) < 0) perror("unshare");
 }
 
-// Add entry to timeline for final summary
-static void add_timeline_entry(int client_id, int elapsed_time) {
-    TimelineEntry *entry = malloc(sizeof(TimelineEntry));
-    if (!entry) return;
-    entry->client_id = client_id;
-    entry->elapsed_time = elapsed_time;
-    entry->next = NULL;
+// Launches a shell job and hands it to the supervisor; never waits on the children
+void start_shell_job(Job *job) {
+    safe_log("(%d) --- started (-1)\n", job->client_id);
     
-    if (!timeline_head) {
-        timeline_head = timeline_tail = entry;
-    } else {
-        timeline_tail->next = entry;
-        timeline_tail = entry;
+    exec_result_init(&job->result, g_output_limit);
+    isolate_job_begin(&g_isolate, job->id, &job->iso);
+    // The whole command list runs as this one job, one pipeline after another
+    job->list_pos = 0;
+    job->list_arena = (Arena){0};
+    int perr = parse_list(&job->list_arena, job->command, &job->list);
+    if (perr != PARSE_SUCCESS) {
+        job->result.parse_err = perr;
+        exec_record_syntax_error(&job->result);
+    }
+    job->exec.res = &job->result;
+    if (launch_next_pipeline(job) < 0) {
+        finish_shell_job(&job->exec, job);  // Nothing to run (syntax error)
+        return;
     }
+    sv_add(&g_supervisor, &job->exec, finish_shell_job, job);
 }
 
-// Clear timeline entries without printing (for non-preemptive scenarios)
-static void clear_timeline(void) {
-    TimelineEntry *curr = timeline_head;
-    while (curr) {
-        TimelineEntry *next = curr->next;
-        free(curr);
-        curr = next;
+// Supervisor thread: collects output and exit status of every running shell job
+void *supervisor_loop(void *arg) {
+    (void)arg;
+    enter_private_cwd();  // Starts the later pipelines of command lists
+    while (!g_stop) {
+        if (sv_run_once(&g_supervisor, -1) < 0) break;
     }
-    timeline_head = timeline_tail = NULL;
+    return NULL;
 }
 
-// Print final timeline summary when queue becomes empty
-static void print_timeline_summary(void) {
-    if (!timeline_head) return;
-    
-    TimelineEntry *curr = timeline_head;
-    printf("\n0)-");  // Always start with "0)-"
-    while (curr) {
-        printf("P%d-(%d)", curr->client_id, curr->elapsed_time);
-        if (curr->next) printf("-");
-        curr = curr->next;
-    }
-    printf("\n");
-    
-    // Free timeline entries and reset global time for next scenario
-    clear_timeline();
-    global_time = 0;  // Reset for next test scenario
+// One tick of a demo job: the server simulates the program's work by sleeping
+static void demo_tick(void *ctx, Job *job) {
+    (void)ctx;
+    sleep(1); // Simulate work
+
+    int current_progress = job->initial_burst - job->remaining_time;
+    char buf[64];
+    snprintf(buf, sizeof(buf), "Demo %d/%d", current_progress, job->initial_burst);
+    safe_send_line(job->client_fd, buf);
+
+    // Track bytes sent (each Demo line)
+    job->bytes_sent += strlen(buf);
 }
 
 void *scheduler_loop(void *arg) {
     (void)arg;
+    enter_private_cwd();
     while (!g_stop) {
-        pthread_mutex_lock(&queue_mutex);
+        pthread_mutex_lock(&g_sched.lock);
         // Wait until there is work to do (either shell or demo/program jobs)
-        while (shell_queue_head == NULL && job_queue_head == NULL && !g_stop) {
+        while (g_sched.shell_head == NULL && g_sched.job_head == NULL && !g_stop) {
             // When both queues become empty, print timeline summary if we have any timeline data
-            if (timeline_head != NULL) {
-                print_timeline_summary();
-            }
-            pthread_cond_wait(&queue_cond, &queue_mutex);
+            sched_print_timeline(&g_sched, stdout);
+            pthread_cond_wait(&g_sched.cond, &g_sched.lock);
         }
         if (g_stop) { 
             // On shutdown, print timeline summary if we have any timeline data
-            if (timeline_head != NULL) {
-                print_timeline_summary();
-            }
-            pthread_mutex_unlock(&queue_mutex); 
+            sched_print_timeline(&g_sched, stdout);
+            pthread_mutex_unlock(&g_sched.lock); 
             break; 
         }
-
-        // Scheduling policy:
-        // 1) Shell commands always have absolute priority - run immediately to completion (FIFO)
-        // 2) Demo/program jobs scheduled using RR+SRJF only when no shell commands pending
-        Job *job = NULL;
-        
-        if (shell_queue_head != NULL) {
-            // Shell command available - take from front of shell queue (FIFO)
-            job = shell_queue_head;
-            shell_queue_head = shell_queue_head->next;
-            job->next = NULL;
-            // Shell jobs don't update last_job_id (they're outside RR rotation)
-        } else {
-            // No shell commands - select from demo/program queue using RR+SRJF
-            job = select_job(1, NULL, last_job_id);
-            // Track currently running job for preemption checks
-            current_running_job = job;
-            if (job) {
-                // Update last_job_id to track which job just ran (for fairness)
-                last_job_id = job->id;
-            }
-        }
-        pthread_mutex_unlock(&queue_mutex);
+        Job *job = sched_next(&g_sched);
+        pthread_mutex_unlock(&g_sched.lock);
 
         if (!job) continue;
 
-        // Mark the arrival epoch when this job starts its current run
-        // Any job with arrival_seq > run_epoch_seq arrived "during" this run
-        job->run_epoch_seq = g_job_arrival_counter;
-
         if (job->type == JOB_CMD) {
-            run_shell_job(job);
-            safe_send_line(job->client_fd, "<<EOF>>"); 
-            // Shell jobs execute instantly for timeline purposes (assume negligible time)
-            // We don't increment global_time for shell commands in this model
-            // But we still add a timeline entry if needed
+            // Shell jobs are only launched here; the supervisor thread reaps them
+            // and hands the finished job to a delivery thread, which sends its
+            // output and <<EOF>> and frees it
+            start_shell_job(job);
+        } else if (!sched_after_run(&g_sched, job, sched_run_quantum(&g_sched, job, demo_tick, NULL))) {
+            // Job completed - log bytes summary and ended
+            if (job->bytes_sent > 0) {
+                safe_log("[%d] <<< %zu bytes sent\n", job->client_id, job->bytes_sent);
+            }
+            safe_log("(%d) --- ended (%d)\n", job->client_id, job->remaining_time);
+
+            safe_send_line(job->client_fd, "<<EOF>>");
             free(job->command);
             free(job);
-        } else {
-            int remaining_before = job->remaining_time;
-            run_demo_job(job);
-            int remaining_after = job->remaining_time;
-            
-            // Calculate time spent in this quantum and update global time
-            int time_spent = remaining_before - remaining_after;
-            global_time += time_spent;
-            
-            // Record timeline entry with global elapsed time
-            add_timeline_entry(job->client_id, global_time);
-            
-            if (job->remaining_time > 0) {
-                pthread_mutex_lock(&queue_mutex);
-                job->next = job_queue_head;
-                job_queue_head = job;
-                pthread_mutex_unlock(&queue_mutex);
-            } else {
-                // Job completed - log bytes summary and ended
-                if (job->bytes_sent > 0) {
-                    safe_log("[%d] <<< %d bytes sent\n", job->client_id, job->bytes_sent);
-                }
-                safe_log("(%d) --- ended (%d)\n", job->client_id, job->remaining_time);
-                
-                safe_send_line(job->client_fd, "<<EOF>>");
-                free(job->command);
-                free(job);
-            }
         }
-        
-        // FIXED: Clear running job after execution completes (whether finished or preempted)
-        pthread_mutex_lock(&queue_mutex);
-        current_running_job = NULL;
-        pthread_mutex_unlock(&queue_mutex);
     }
     return NULL;
 }
 
+// Burst of a demo command line: its last word, so demo's workload options can
+// come first. Falls back to 5 ticks when that word is not a positive number.
+static int parse_demo_burst(const char *cmd) {
+    const char *end = cmd + strlen(cmd);
+    while (end > cmd && isspace((unsigned char)end[-1])) end--;
+    const char *word = end;
+    while (word > cmd && !isspace((unsigned char)word[-1])) word--;
+    if (word == cmd) return 5;  // Only the program name
+    char *stop;
+    long burst = strtol(word, &stop, 10);
+    if (stop != end || burst <= 0 || burst > INT_MAX) return 5;
+    return (int)burst;
+}
+
 typedef struct { int fd; int id; } client_t;
 
+// Drops len payload bytes from the socket
+static int discard_payload(int client_fd, size_t len) {
+    char buf[4096];
+    while (len > 0) {
+        ssize_t r = recv(client_fd, buf, len < sizeof(buf) ? len : sizeof(buf), 0);
+        if (r <= 0) return -1;
+        len -= r;
+    }
+    return 0;
+}
+
+// Moves the client's FRAME_STDIN payloads into the job's stdin pipe until the
+// empty EOF frame. splice() keeps the bytes in the kernel, and because it blocks
+// while the pipe is full we stop reading the socket, so TCP flow control throttles
+// the client to the pace of the command. If the command stops reading (EPIPE) the
+// rest of the upload is discarded to keep the frame stream in sync.
+// Closes pipe_fd; returns -1 if the client went away or broke the protocol.
+static int pump_client_stdin(int client_id, int client_fd, int pipe_fd) {
+    size_t total = 0;
+    int rc = 0;
+    for (;;) {
+        int type;
+        int len = receive_frame_header(client_fd, &type);
+        if (len < 0 || type != FRAME_STDIN) {
+            rc = -1;
+            break;
+        }
+        if (len == 0) break;  // EOF
+        total += len;
+
+        while (len > 0 && pipe_fd >= 0) {
+            ssize_t n = splice(client_fd, NULL, pipe_fd, NULL, len, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (n > 0) {
+                len -= n;
+            } else if (n == 0) {
+                rc = -1;  // Client disconnected mid-frame
+                break;
+            } else if (errno == EPIPE) {
+                close(pipe_fd);  // Command no longer reads its input
+                pipe_fd = -1;
+            } else if (errno != EINTR) {
+                perror("splice");
+                rc = -1;
+                break;
+            }
+        }
+        if (rc < 0) break;
+        if (len > 0 && discard_payload(client_fd, len) < 0) {
+            rc = -1;
+            break;
+        }
+    }
+    if (pipe_fd >= 0) close(pipe_fd);
+    safe_log("[%d] >>> %zu bytes of stdin\n", client_id, total);
+    return rc;
+}
+
+// Sends a result produced without a job (cache hit, session builtin)
+static void send_direct_result(int client_fd, const ExecResult *res) {
+    pthread_mutex_t *reply = &g_reply_locks[client_fd % SEND_LOCK_SLOTS];
+    pthread_mutex_lock(reply);
+    send_capture(client_fd, FRAME_DATA, &res->out);
+    send_capture(client_fd, FRAME_STDERR, &res->err);
+    send_status(client_fd, res);
+    safe_send_line(client_fd, "<<EOF>>");
+    pthread_mutex_unlock(reply);
+}
+
+// Runs a session builtin (cd, export, unset) on the client's own thread.
+// Returns 1 if cmd was one.
+static int answer_builtin(int client_id, int client_fd, Session *session, const char *cmd) {
+    ExecResult res;
+    exec_result_init(&res, g_output_limit);
+    if (!session_builtin(session, cmd, &res)) {
+        exec_result_free(&res);
+        return 0;
+    }
+    safe_log("[%d] <<< builtin, exit %d\n", client_id, res.exit_status);
+    capture_finish(&res.out);
+    capture_finish(&res.err);
+    send_direct_result(client_fd, &res);
+    exec_result_free(&res);
+    return 1;
+}
+
+// Answers a command from the result cache on the client's own thread, without
+// queuing a job. Returns 1 on a hit; otherwise 0 and, if the command is cacheable,
+// its key in *key for the job to store its result under.
+static int answer_from_cache(int client_id, int client_fd, const char *cmd, char **key, size_t *key_len) {
+    *key = rcache_key(&g_rcache, cmd, key_len);
+    if (!*key) return 0;
+
+    ExecResult res;
+    exec_result_init(&res, 0);
+    if (!rcache_lookup(&g_rcache, *key, *key_len, &res)) {
+        exec_result_free(&res);
+        return 0;
+    }
+    safe_log("[%d] <<< cache hit, %zu bytes sent\n", client_id, res.out.len + res.err.len);
+    send_direct_result(client_fd, &res);
+    exec_result_free(&res);
+    free(*key);
+    *key = NULL;
+    return 1;
+}
+
 void *handle_client_input(void *arg) {
     client_t *info = (client_t*)arg;
     int client_fd = info->fd;
     int client_id = info->id;
     free(info);
+    // The session outlives the connection while its jobs still run
+    Session *session = g_sessions ? session_new() : NULL;
 
-    char buffer[MAX_CMD_LENGTH];
+    char *buffer = NULL;  // Grows to the longest command this client sends
+    size_t buffer_size = 0;
 
     while (!g_stop) {
-        int bytes = receive_line(client_fd, buffer, sizeof(buffer));
+        int type;
+        int bytes = receive_frame_alloc(client_fd, &type, &buffer, &buffer_size);
         if (bytes <= 0) break; 
         if (strcmp(buffer, "exit") == 0) break;
-        if (strlen(buffer) == 0) continue;
+
+        // FRAME_CMD_STDIN: the command's stdin follows as FRAME_STDIN frames
+        int upload[2] = { -1, -1 };
+        if (type == FRAME_CMD_STDIN && pipe2(upload, O_CLOEXEC) < 0) {
+            perror("pipe2");
+            break;
+        }
+        if (strlen(buffer) == 0) {
+            if (upload[0] >= 0) close(upload[0]);
+            if (upload[1] >= 0 && pump_client_stdin(client_id, client_fd, upload[1]) < 0) break;
+            continue;
+        }
 
         safe_log("[%d] >>> %s\n", client_id, buffer);
 
+        if (session && upload[1] < 0 && answer_builtin(client_id, client_fd, session, buffer)) continue;
+
+        // Commands declared pure may be answered from the cache (never with an upload).
+        // Session commands depend on per-client state the key does not cover.
+        char *cache_key = NULL;
+        size_t cache_key_len = 0;
+        if (!session && upload[1] < 0 && answer_from_cache(client_id, client_fd, buffer, &cache_key, &cache_key_len)) continue;
+
         Job *job = malloc(sizeof(Job));
         job->id = ++job_id_counter;
         job->client_id = client_id;
@@ -569,35 +593,129 @@ void *handle_client_input(void *arg) {
         job->command = xstrdup(buffer);
         job->rounds_run = 0;
         job->bytes_sent = 0;  // Initialize bytes counter
-        job->arrival_seq = ++g_job_arrival_counter;  // Track arrival order
+        job->arrival_seq = 0;  // Set when it is queued
         job->run_epoch_seq = 0;  // Will be set when job starts running
+        job->stdin_fd = upload[0];
+        job->cache_key = cache_key;
+        job->cache_key_len = cache_key_len;
+        job->followers = NULL;
+        job->inflight_next = NULL;
+        job->session = NULL;
         job->next = NULL;
 
         // Parse command type and route to appropriate queue
         if (strncmp(buffer, "demo", 4) == 0 || strncmp(buffer, "./demo", 6) == 0 || strncmp(buffer, "/demo", 5) == 0) {
             // Demo/program command: goes into RR+SRJF scheduling queue
             job->type = JOB_DEMO;
-            char *space = strchr(buffer, ' ');
-            if (space) job->initial_burst = atoi(space + 1);
-            else job->initial_burst = 5; 
+            job->initial_burst = parse_demo_burst(buffer);
             job->remaining_time = job->initial_burst;
+            if (job->stdin_fd >= 0) {
+                close(job->stdin_fd);  // Demo programs take no input
+                job->stdin_fd = -1;
+            }
+            free(job->cache_key);  // Simulated runs produce nothing worth caching
+            job->cache_key = NULL;
             add_job(job);  // Add to demo/program queue
         } else {
             // Shell command: immediate execution path (not in RR queue)
             job->type = JOB_CMD;
             job->initial_burst = -1; 
             job->remaining_time = 0; 
-            add_shell_job(job);  // Add to immediate-priority shell queue
+            if (session) {
+                session_hold(session);
+                job->session = session;
+            }
+            // Duplicates of a cacheable command already in flight share its run
+            if (!job->cache_key || !join_inflight(job)) {
+                add_shell_job(job);  // Add to immediate-priority shell queue
+            }
         }
+
+        // Upload stdin right here: the job may already be running and reading it
+        if (upload[1] >= 0 && pump_client_stdin(client_id, client_fd, upload[1]) < 0) break;
     }
     
+    free(buffer);
+    session_release(session);
     close_socket(client_fd);
     safe_log("[%d] <<< client disconnected\n", client_id);
     return NULL;
 }
 
 int main(int argc, char *argv[]) {
-    (void)argc; (void)argv;
+    int opt;
+    const char *pure_cmds = NULL;
+    long cache_ttl_ms = RCACHE_DEFAULT_TTL_MS;
+    int plan_entries = PLAN_CACHE_DEFAULT_ENTRIES;
+    const char *trace_path = NULL;
+    while ((opt = getopt(argc, argv, "m:g:c:M:p:s:P:r:t:SL:T:")) != -1) {
+        switch (opt) {
+            case 'm':
+                // Maximum bytes of output kept per job (0 = unlimited)
+                g_output_limit = strtoull(optarg, NULL, 10);
+                break;
+            case 'g':
+                // Delegated cgroup v2 directory; each shell job gets a leaf under it
+                g_isolate.cgroup_root = optarg;
+                break;
+            case 'c':
+                // cpu.max per job, e.g. "50000 100000" for half a CPU
+                g_isolate.cpu_max = optarg;
+                break;
+            case 'M':
+                g_isolate.memory_max = strtoll(optarg, NULL, 10);
+                break;
+            case 'p':
+                g_isolate.pids_max = strtol(optarg, NULL, 10);
+                break;
+            case 's':
+            case 'P': {
+                // CPU lists: -s for shell jobs, -P for program jobs and the server's own threads
+                cpu_set_t *set = (opt == 's') ? &g_isolate.shell_cpus : &g_isolate.server_cpus;
+                if (isolate_parse_cpulist(optarg, set) < 0) {
+                    fprintf(stderr, "Invalid CPU list: %s\n", optarg);
+                    exit(1);
+                }
+                if (opt == 's') g_isolate.pin_shell = 1;
+                else g_isolate.pin_server = 1;
+                break;
+            }
+            case 'r':
+                // Comma-separated commands whose output may be cached, e.g. "cat,ls,wc"
+                pure_cmds = optarg;
+                break;
+            case 't':
+                cache_ttl_ms = strtol(optarg, NULL, 10);
+                break;
+            case 'S':
+                g_sessions = 1;
+                break;
+            case 'L':
+                // Parsed plans kept for repeated command text (0 = parse every time)
+                plan_entries = atoi(optarg);
+                break;
+            case 'T':
+                // Write every scheduled job's arrival to this JSONL trace (replay with schedsim)
+                trace_path = optarg;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-m max_output_bytes] [-g cgroup_dir] [-c cpu_max] [-M memory_max]\n"
+                                "       [-p pids_max (cgroup v2 only)] [-s shell_cpus] [-P server_cpus] [-r pure_cmds] [-t cache_ttl_ms] [-S]\n"
+                                "       [-L plan_cache_entries] [-T trace_file]\n", argv[0]);
+                exit(1);
+        }
+    }
+    // Pins this thread (and so every thread created below) and prepares the cgroup root
+    isolate_init(&g_isolate);
+    if (g_sessions) g_server_cwd = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (rcache_init(&g_rcache, pure_cmds, cache_ttl_ms) < 0) exit(1);
+    plan_cache_init(&g_plans, plan_entries);
+    sched_init(&g_sched, safe_log);
+    for (int i = 0; i < SEND_LOCK_SLOTS; i++) {
+        pthread_mutex_init(&g_send_locks[i], NULL);
+        pthread_mutex_init(&g_reply_locks[i], NULL);
+    }
+    if (trace_path && trace_open(&g_trace, trace_path) < 0) exit(1);
     
     // FIXED: Use standard function pointer, not lambda
     signal(SIGINT, handle_sigint);
@@ -610,8 +728,11 @@ int main(int argc, char *argv[]) {
     printf("| Hello, Server Started |\n");
     printf("-------------------------\n");
 
-    pthread_t sched_tid;
+    if (sv_init(&g_supervisor) < 0) exit(1);
+
+    pthread_t sched_tid, sv_tid;
     pthread_create(&sched_tid, NULL, scheduler_loop, NULL);
+    pthread_create(&sv_tid, NULL, supervisor_loop, NULL);
 
     while(!g_stop) {
         struct sockaddr_in addr;
@@ -633,6 +754,7 @@ int main(int argc, char *argv[]) {
     
     // FIXED: Wait for scheduler thread to exit cleanly
     pthread_join(sched_tid, NULL);
+    pthread_join(sv_tid, NULL);
     
     return 0;
 }
@@ -0,0 +1,250 @@
+#define _GNU_SOURCE
+#include "session.h"
+#include "tokenize.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+static const char *env_get(const Session *s, const char *name) {
+    size_t n = strlen(name);
+    for (int i = 0; i < s->nenv; i++) {
+        if (strncmp(s->env[i], name, n) == 0 && s->env[i][n] == '=') return s->env[i] + n + 1;
+    }
+    return NULL;
+}
+
+static void env_unset(Session *s, const char *name) {
+    size_t n = strlen(name);
+    for (int i = 0; i < s->nenv; i++) {
+        if (strncmp(s->env[i], name, n) == 0 && s->env[i][n] == '=') {
+            free(s->env[i]);
+            s->env[i] = s->env[--s->nenv];
+            s->env[s->nenv] = NULL;
+            return;
+        }
+    }
+}
+
+// Sets name=value, keeping env NULL-terminated. Returns 0 or -1.
+static int env_set(Session *s, const char *name, const char *value) {
+    size_t n = strlen(name), v = strlen(value);
+    char *entry = malloc(n + v + 2);
+    if (!entry) {
+        perror("malloc");
+        return -1;
+    }
+    memcpy(entry, name, n);
+    entry[n] = '=';
+    memcpy(entry + n + 1, value, v + 1);
+
+    env_unset(s, name);
+    if (s->nenv + 1 >= s->env_cap) {
+        int cap = s->env_cap ? s->env_cap * 2 : 64;
+        char **env = realloc(s->env, cap * sizeof(char *));
+        if (!env) {
+            perror("realloc");
+            free(entry);
+            return -1;
+        }
+        s->env = env;
+        s->env_cap = cap;
+    }
+    s->env[s->nenv++] = entry;
+    s->env[s->nenv] = NULL;
+    return 0;
+}
+
+static void clear_paths(Session *s) {
+    for (int i = 0; i < s->npaths; i++) {
+        free(s->paths[i].name);
+        free(s->paths[i].path);
+    }
+    s->npaths = 0;
+    s->next_evict = 0;
+}
+
+Session *session_new(void) {
+    Session *s = calloc(1, sizeof(Session));
+    if (!s) {
+        perror("calloc");
+        return NULL;
+    }
+    pthread_mutex_init(&s->lock, NULL);
+    s->refs = 1;
+    if (!getcwd(s->cwd, sizeof(s->cwd))) strcpy(s->cwd, "/");
+
+    // env_set() always leaves room for the terminator, so an empty environ is fine
+    s->env = calloc(64, sizeof(char *));
+    s->env_cap = s->env ? 64 : 0;
+    for (char **e = environ; *e && s->env; e++) {
+        char *eq = strchr(*e, '=');
+        if (!eq) continue;
+        char *name = strndup(*e, eq - *e);
+        if (name) env_set(s, name, eq + 1);
+        free(name);
+    }
+    return s;
+}
+
+void session_hold(Session *s) {
+    pthread_mutex_lock(&s->lock);
+    s->refs++;
+    pthread_mutex_unlock(&s->lock);
+}
+
+void session_release(Session *s) {
+    if (!s) return;
+    pthread_mutex_lock(&s->lock);
+    int left = --s->refs;
+    pthread_mutex_unlock(&s->lock);
+    if (left > 0) return;
+
+    clear_paths(s);
+    for (int i = 0; i < s->nenv; i++) free(s->env[i]);
+    free(s->env);
+    pthread_mutex_destroy(&s->lock);
+    free(s);
+}
+
+static void builtin_error(ExecResult *res, const char *fmt, const char *a, const char *b) {
+    char msg[PATH_MAX + 128];
+    int n = snprintf(msg, sizeof(msg), fmt, a, b);
+    capture_append(&res->err, msg, n < (int)sizeof(msg) ? n : (int)sizeof(msg) - 1);
+    res->exit_status = 1;
+}
+
+// cd [dir | -]: resolves against the session's cwd; the server itself never moves
+static void builtin_cd(Session *s, const char *arg, ExecResult *res) {
+    const char *target = arg ? arg : env_get(s, "HOME");
+    int announce = 0;
+    if (arg && strcmp(arg, "-") == 0) {
+        target = env_get(s, "OLDPWD");
+        announce = 1;
+    }
+    if (!target) {
+        builtin_error(res, "cd: %s not set\n", arg ? "OLDPWD" : "HOME", NULL);
+        return;
+    }
+
+    char path[PATH_MAX * 2 + 2], resolved[PATH_MAX];
+    if (target[0] == '/') snprintf(path, sizeof(path), "%s", target);
+    else snprintf(path, sizeof(path), "%s/%s", s->cwd, target);
+    struct stat st;
+    if (!realpath(path, resolved) || stat(resolved, &st) < 0) {
+        builtin_error(res, "cd: %s: %s\n", target, strerror(errno));
+        return;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        builtin_error(res, "cd: %s: %s\n", target, strerror(ENOTDIR));
+        return;
+    }
+    if (access(resolved, X_OK) < 0) {
+        builtin_error(res, "cd: %s: %s\n", target, strerror(errno));
+        return;
+    }
+
+    env_set(s, "OLDPWD", s->cwd);
+    snprintf(s->cwd, sizeof(s->cwd), "%s", resolved);
+    env_set(s, "PWD", s->cwd);
+    if (announce) {
+        capture_append(&res->out, s->cwd, strlen(s->cwd));
+        capture_append(&res->out, "\n", 1);
+    }
+}
+
+int session_builtin(Session *s, const char *cmd, ExecResult *res) {
+    Arena a = {0};
+    QTok *toks = NULL;
+    int nt = 0;
+    if (qtokenize(&a, cmd, &toks, &nt) != 0) {
+        arena_destroy(&a);
+        return 0;
+    }
+    int is_cd = 0, is_export = 0, is_unset = 0;
+    if (nt > 0 && !toks[0].was_quoted) {
+        is_cd = strcmp(toks[0].val, "cd") == 0;
+        is_export = strcmp(toks[0].val, "export") == 0;
+        is_unset = strcmp(toks[0].val, "unset") == 0;
+    }
+    // With a pipe, redirection or list operator it is a command line for the exec layer
+    static const char *const ops[] = { "|", "<", ">", ">>", "2>", ";", "&&", "||", "(", ")" };
+    for (int i = 1; i < nt; i++) {
+        for (size_t k = 0; !toks[i].was_quoted && k < sizeof(ops) / sizeof(ops[0]); k++) {
+            if (strcmp(toks[i].val, ops[k]) == 0) is_cd = is_export = is_unset = 0;
+        }
+    }
+    if (!is_cd && !is_export && !is_unset) {
+        arena_destroy(&a);
+        return 0;
+    }
+
+    res->exit_status = 0;
+    pthread_mutex_lock(&s->lock);
+    if (is_cd) {
+        if (nt > 2) builtin_error(res, "cd: %s%s\n", "too many arguments", "");
+        else builtin_cd(s, nt > 1 ? toks[1].val : NULL, res);
+    } else if (is_export && nt == 1) {
+        for (int i = 0; i < s->nenv; i++) {
+            capture_append(&res->out, s->env[i], strlen(s->env[i]));
+            capture_append(&res->out, "\n", 1);
+        }
+    } else {
+        for (int i = 1; i < nt; i++) {
+            char *eq = strchr(toks[i].val, '=');
+            if (is_export && !eq) continue;  // Every session variable is exported already
+            if (eq) *eq = '\0';
+            if (toks[i].val[0] == '\0') {
+                builtin_error(res, "%s: not a valid identifier: %s\n", toks[0].val, eq ? eq + 1 : "");
+                continue;
+            }
+            if (is_export) env_set(s, toks[i].val, eq + 1);
+            else env_unset(s, toks[i].val);
+            // A new PATH can change what every name resolves to
+            if (strcmp(toks[i].val, "PATH") == 0) clear_paths(s);
+        }
+    }
+    pthread_mutex_unlock(&s->lock);
+    arena_destroy(&a);
+    return 1;
+}
+
+const char *session_resolve(void *ctx, const char *name) {
+    Session *s = ctx;
+    for (int i = 0; i < s->npaths; i++) {
+        if (strcmp(s->paths[i].name, name) == 0) return s->paths[i].path;
+    }
+
+    const char *pathvar = env_get(s, "PATH");
+    if (!pathvar) return NULL;
+    char candidate[PATH_MAX];
+    for (const char *dir = pathvar; ; ) {
+        const char *end = strchrnul(dir, ':');
+        // Relative entries depend on the cwd at run time: leave those to execvp()
+        if (end == dir || dir[0] != '/') return NULL;
+        int n = snprintf(candidate, sizeof(candidate), "%.*s/%s", (int)(end - dir), dir, name);
+        struct stat st;
+        if (n < (int)sizeof(candidate) && stat(candidate, &st) == 0 && S_ISREG(st.st_mode) && access(candidate, X_OK) == 0) {
+            break;
+        }
+        if (!*end) return NULL;
+        dir = end + 1;
+    }
+
+    // Remember it, replacing round-robin once the cache is full
+    SessionPath *slot;
+    if (s->npaths < SESSION_PATH_CACHE) {
+        slot = &s->paths[s->npaths++];
+    } else {
+        slot = &s->paths[s->next_evict];
+        s->next_evict = (s->next_evict + 1) % SESSION_PATH_CACHE;
+        free(slot->name);
+        free(slot->path);
+    }
+    slot->name = xstrdup(name);
+    slot->path = xstrdup(candidate);
+    return slot->path;
+}
@@ -0,0 +1,155 @@
+#include "supervisor.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#define SV_MAX_EVENTS 64
+
+typedef struct SvEntry SvEntry;
+
+// One registered fd; epoll hands this back as data.ptr
+typedef struct {
+    SvEntry *entry;
+    int fd;
+    int stage;              // Index into pidfds, or -1 for a capture pipe
+} SvWatch;
+
+struct SvEntry {
+    ExecJob *job;
+    sv_done_fn done;
+    void *arg;
+    int queued;             // Already on this batch's completion list
+    SvEntry *next_done;
+    SvWatch watches[];      // out, err, then one per stage
+};
+
+int sv_init(Supervisor *sv) {
+    sv->active = 0;
+    pthread_mutex_init(&sv->lock, NULL);
+    sv->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (sv->epfd < 0) {
+        perror("epoll_create1");
+        return -1;
+    }
+    sv->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (sv->wake_fd < 0) {
+        perror("eventfd");
+        close(sv->epfd);
+        return -1;
+    }
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+    epoll_ctl(sv->epfd, EPOLL_CTL_ADD, sv->wake_fd, &ev);
+    return 0;
+}
+
+void sv_destroy(Supervisor *sv) {
+    close(sv->wake_fd);
+    close(sv->epfd);
+    pthread_mutex_destroy(&sv->lock);
+}
+
+void sv_wake(Supervisor *sv) {
+    uint64_t one = 1;
+    ssize_t r = write(sv->wake_fd, &one, sizeof(one));
+    (void)r;
+}
+
+static int sv_watch(Supervisor *sv, SvWatch *w) {
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = w };
+    if (epoll_ctl(sv->epfd, EPOLL_CTL_ADD, w->fd, &ev) < 0) {
+        perror("epoll_ctl");
+        return -1;
+    }
+    return 0;
+}
+
+int sv_add(Supervisor *sv, ExecJob *job, sv_done_fn done, void *arg) {
+    if (job->pending == 0) {
+        exec_job_finish(job);
+        done(job, arg);
+        return 0;
+    }
+
+    int nstages = job->res->nstages - job->base;
+    SvEntry *e = malloc(sizeof(SvEntry) + (nstages + 2) * sizeof(SvWatch));
+    if (!e) {
+        perror("malloc");
+        return -1;
+    }
+    e->job = job;
+    e->done = done;
+    e->arg = arg;
+    e->queued = 0;
+    e->next_done = NULL;
+
+    pthread_mutex_lock(&sv->lock);
+    job->epfd = sv->epfd;
+    sv->active++;
+    int nw = 0;
+    int fds[2] = { job->out_fd, job->err_fd };
+    for (int i = 0; i < 2; i++) {
+        if (fds[i] < 0) continue;
+        e->watches[nw] = (SvWatch){ .entry = e, .fd = fds[i], .stage = -1 };
+        sv_watch(sv, &e->watches[nw++]);
+    }
+    for (int i = 0; job->pidfds && i < nstages; i++) {
+        if (job->pidfds[i] < 0) continue;
+        e->watches[nw] = (SvWatch){ .entry = e, .fd = job->pidfds[i], .stage = i };
+        sv_watch(sv, &e->watches[nw++]);
+    }
+    pthread_mutex_unlock(&sv->lock);
+    return 0;
+}
+
+int sv_run_once(Supervisor *sv, int timeout_ms) {
+    struct epoll_event events[SV_MAX_EVENTS];
+    int n = epoll_wait(sv->epfd, events, SV_MAX_EVENTS, timeout_ms);
+    if (n < 0) {
+        if (errno == EINTR) return 0;
+        perror("epoll_wait");
+        return -1;
+    }
+
+    SvEntry *done_list = NULL;
+    pthread_mutex_lock(&sv->lock);
+    for (int i = 0; i < n; i++) {
+        SvWatch *w = events[i].data.ptr;
+        if (!w) {
+            uint64_t v;
+            ssize_t r = read(sv->wake_fd, &v, sizeof(v));
+            (void)r;
+            continue;
+        }
+        SvEntry *e = w->entry;
+        ExecJob *job = e->job;
+        // An earlier event in this batch may already have closed this fd
+        if (w->stage < 0) {
+            if (w->fd == job->out_fd || w->fd == job->err_fd) exec_job_on_output(job, w->fd);
+        } else if (job->pidfds[w->stage] == w->fd) {
+            exec_job_on_exit(job, w->stage);
+        }
+        if (job->pending == 0 && !e->queued) {
+            e->queued = 1;
+            e->next_done = done_list;
+            done_list = e;
+            sv->active--;
+        }
+    }
+    pthread_mutex_unlock(&sv->lock);
+
+    // Every fd of a completed job is closed and unregistered, so its entry can go
+    int completed = 0;
+    while (done_list) {
+        SvEntry *e = done_list;
+        done_list = e->next_done;
+        exec_job_finish(e->job);
+        e->done(e->job, e->arg);
+        free(e);
+        completed++;
+    }
+    return completed;
+}
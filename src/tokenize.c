@@ -1,125 +1,213 @@
 #include "tokenize.h"
-#include "util.h"
-#include <glob.h>
+#include "globber.h"
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <errno.h>
 
-#define MAX_CMD_LENGTH 1024 
-#define MAX_ARGS 64         
 
-int qtokenize(const char *line, QTok **out, int *count){
+// Returns the next free token slot, doubling the array (in the arena) when full
+static QTok *next_tok(Arena *a, QTok **arr, int *cap, int n){
+    if(n==*cap){
+        QTok *tmp = arena_alloc(a, *cap*2*sizeof(QTok));
+        memcpy(tmp, *arr, n*sizeof(QTok));
+        *arr=tmp; *cap*=2;
+    }
+    return &(*arr)[n];
+}
+
+static bool is_space(char c){
+    return c==' '||c=='\t'||c=='\n'||c=='\r';
+}
+
+// Bytes that end a run of plain characters outside quotes. A lone & is not an
+// operator, so the caller takes it back as a plain character.
+static const bool plain_stop[256] = {
+    [' ']=1, ['\t']=1, ['\n']=1, ['\r']=1, ['\'']=1, ['"']=1,
+    ['|']=1, ['<']=1, ['>']=1, [';']=1, ['(']=1, [')']=1, ['&']=1,
+};
+
+// Scans VEC_WIDTH bytes at a time with one compare per character of interest;
+// the scalar loops below finish the tail (and are all there is without SIMD,
+// or when built with -DTOKENIZE_SCALAR)
+#if defined(__AVX2__) && !defined(TOKENIZE_SCALAR)
+#include <immintrin.h>
+#define VEC_WIDTH 32
+typedef __m256i vec_t;
+#define vec_load(p)  _mm256_loadu_si256((const __m256i *)(p))
+#define vec_eq(v, c) _mm256_cmpeq_epi8((v), _mm256_set1_epi8(c))
+#define vec_or(x, y) _mm256_or_si256((x), (y))
+#define vec_mask(v)  (uint32_t)_mm256_movemask_epi8(v)
+#elif defined(__SSE2__) && !defined(TOKENIZE_SCALAR)
+#include <emmintrin.h>
+#define VEC_WIDTH 16
+typedef __m128i vec_t;
+#define vec_load(p)  _mm_loadu_si128((const __m128i *)(p))
+#define vec_eq(v, c) _mm_cmpeq_epi8((v), _mm_set1_epi8(c))
+#define vec_or(x, y) _mm_or_si128((x), (y))
+#define vec_mask(v)  (uint32_t)_mm_movemask_epi8(v)
+#endif
+
+// First byte in [p, end) that plain_stop[] flags, or end
+static const char *scan_plain(const char *p, const char *end){
+#ifdef VEC_WIDTH
+    for(; end-p >= VEC_WIDTH; p += VEC_WIDTH){
+        vec_t v = vec_load(p);
+        vec_t m = vec_or(vec_or(vec_or(vec_eq(v,' '), vec_eq(v,'\t')), vec_or(vec_eq(v,'\n'), vec_eq(v,'\r'))),
+                         vec_or(vec_eq(v,'\''), vec_eq(v,'"')));
+        m = vec_or(m, vec_or(vec_or(vec_eq(v,'|'), vec_eq(v,'<')), vec_or(vec_eq(v,'>'), vec_eq(v,';'))));
+        m = vec_or(m, vec_or(vec_or(vec_eq(v,'('), vec_eq(v,')')), vec_eq(v,'&')));
+        uint32_t bits = vec_mask(m);
+        if(bits) return p + __builtin_ctz(bits);
+    }
+#endif
+    while(p<end && !plain_stop[(unsigned char)*p]) p++;
+    return p;
+}
+
+// First a or b in [p, end), or end: the closing quote (a == b) or, in double
+// quotes, the closing quote or a backslash
+static const char *scan_quoted(const char *p, const char *end, char a, char b){
+#ifdef VEC_WIDTH
+    for(; end-p >= VEC_WIDTH; p += VEC_WIDTH){
+        vec_t v = vec_load(p);
+        uint32_t bits = vec_mask(vec_or(vec_eq(v,a), vec_eq(v,b)));
+        if(bits) return p + __builtin_ctz(bits);
+    }
+#endif
+    while(p<end && *p!=a && *p!=b) p++;
+    return p;
+}
+
+int qtokenize(Arena *a, const char *line, QTok **out, int *count){
     *out=NULL; *count=0;
-    const char *p=line;
+    size_t len = strlen(line);
+    const char *p=line, *end=line+len;
     bool in_s=false, in_d=false;
-    char buf[MAX_CMD_LENGTH];
-    int bl=0;
+
+    // Every value is a slice of this one copy of the line: a plain word is just
+    // NUL-terminated where it ends, a quoted one is unquoted in place (it can
+    // only shrink). Reads always come from line, so nothing is overwritten early.
+    char *copy = arena_strndup(a, line, len);
 
     int cap=16, n=0;
-    QTok *arr = (QTok*)malloc(cap*sizeof(QTok));
-    if(!arr){ perror("malloc"); return -1; }
+    QTok *arr = arena_alloc(a, cap*sizeof(QTok));
 
     while(*p){
-        while(!in_s && !in_d && (*p==' '||*p=='\t'||*p=='\n'||*p=='\r')) p++;
+        while(is_space(*p)) p++;
         if(!*p) break;
 
         bool was_quoted=false;
-        bl=0;
+        int start=(int)(p-line);
+        char *val = copy+start;
+        size_t bl=0;
+
+        // Appends [from, to) to the value; a no-op for runs already in place
+#define PUT_RUN(from, to) do{ \
+            size_t run_ = (size_t)((to)-(from)); \
+            if(val+bl != copy+((from)-line)) memcpy(val+bl, (from), run_); \
+            bl += run_; \
+        }while(0)
 
         while(*p){
+            const char *q;
             if(in_s){
-                if(*p=='\''){ in_s=false; was_quoted=true; p++; continue; }
-                if(bl>=MAX_CMD_LENGTH-1){ free(arr); return -1; }
-                buf[bl++]=*p++;
+                q = scan_quoted(p, end, '\'', '\'');
+                PUT_RUN(p, q);
+                p=q;
+                if(!*p) break;
+                in_s=false; was_quoted=true; p++;
             } else if(in_d){
-                if(*p=='"'){ in_d=false; was_quoted=true; p++; continue; }
-                if(*p=='\\' && (p[1]=='"'||p[1]=='\\')){ p++; if(bl>=MAX_CMD_LENGTH-1){ free(arr); return -1; } buf[bl++]=*p++; }
-                else { if(bl>=MAX_CMD_LENGTH-1){ free(arr); return -1; } buf[bl++]=*p++; }
+                q = scan_quoted(p, end, '"', '\\');
+                PUT_RUN(p, q);
+                p=q;
+                if(!*p) break;
+                if(*p=='"'){ in_d=false; was_quoted=true; p++; }
+                else if(p[1]=='"'||p[1]=='\\'){ PUT_RUN(p+1, p+2); p+=2; }
+                else { PUT_RUN(p, p+1); p++; }
             } else {
-                if(*p=='\''){ in_s=true; p++; continue; }
-                if(*p=='"'){ in_d=true; p++; continue; }
-                if(*p==' '||*p=='\t'||*p=='\n'||*p=='\r') break;
-                // Check for >> before checking for single >
-                if(*p=='>' && p[1]=='>'){
-                    if(bl==0) break;  // >> is an operator, break to handle it separately
-                    else break;       // We have content, break to finish current token
-                }
-                if(*p=='|'||*p=='<'||*p=='>'){
-                    if(bl==0) break;
-                    else break;
-                }
-                if(bl>=MAX_CMD_LENGTH-1){ free(arr); return -1; }
-                buf[bl++]=*p++;
+                q = scan_plain(p, end);
+                PUT_RUN(p, q);
+                p=q;
+                if(!*p) break;
+                if(*p=='\''){ in_s=true; p++; }
+                else if(*p=='"'){ in_d=true; p++; }
+                else break;  // Whitespace or an operator ends the word
             }
         }
+#undef PUT_RUN
 
         if(bl>0 || was_quoted){
-            if(n==cap){ cap*=2; QTok *tmp=realloc(arr, cap*sizeof(QTok)); if(!tmp){ perror("realloc"); free(arr); return -1;} arr=tmp; }
-            buf[bl]='\0';
-            arr[n].val = xstrdup(buf);
-            arr[n].was_quoted = was_quoted;
-            n++;
+            val[bl]='\0';
+            QTok *t = next_tok(a, &arr, &cap, n++);
+            t->val = val;
+            t->was_quoted = was_quoted;
+            t->start = start;
+            t->end = (int)(p-line);
         }
 
-        if(!in_s && !in_d){
-            while(*p==' '||*p=='\t'||*p=='\n'||*p=='\r') p++;
-            if(*p=='2' && p[1]=='>'){
-                if(n==cap){ cap*=2; QTok *tmp=realloc(arr, cap*sizeof(QTok)); if(!tmp){ perror("realloc"); free(arr); return -1;} arr=tmp; }
-                arr[n].val = xstrdup("2>");
-                arr[n].was_quoted=false; n++; p+=2;
-            } else if(*p=='>' && p[1]=='>'){
-                // Handle >> (append redirection) as a single token
-                if(n==cap){ cap*=2; QTok *tmp=realloc(arr, cap*sizeof(QTok)); if(!tmp){ perror("realloc"); free(arr); return -1;} arr=tmp; }
-                arr[n].val = xstrdup(">>");
-                arr[n].was_quoted=false; n++; p+=2;
-            } else if(*p=='|'||*p=='<'||*p=='>'){
-                char op[2]={*p,0};
-                if(n==cap){ cap*=2; QTok *tmp=realloc(arr, cap*sizeof(QTok)); if(!tmp){ perror("realloc"); free(arr); return -1;} arr=tmp; }
-                arr[n].val = xstrdup(op);
-                arr[n].was_quoted=false; n++; p++;
-            }
+        // Operators, possibly several in a row: `(a) 2> err` has ")" and then "2>"
+        while(!in_s && !in_d){
+            while(is_space(*p)) p++;
+            // Two-character operators first: 2>, >>, && and ||
+            int oplen=0;
+            if((*p=='2' && p[1]=='>') || (*p=='>' && p[1]=='>') || (*p=='&' && p[1]=='&') || (*p=='|' && p[1]=='|')) oplen=2;
+            else if(*p=='|'||*p=='<'||*p=='>'||*p==';'||*p=='&'||*p=='('||*p==')') oplen=1;
+            if(!oplen) break;
+            // The copy's byte here may already hold the previous word's NUL
+            QTok *t = next_tok(a, &arr, &cap, n++);
+            t->val = arena_strndup(a, p, oplen);
+            t->was_quoted = false;
+            t->start = (int)(p-line);
+            t->end = t->start+oplen;
+            p+=oplen;
         }
     }
 
-    if(in_s||in_d){
-        for(int i=0;i<n;i++) free(arr[i].val);
-        free(arr);
-        return -1;
-    }
+    if(in_s||in_d) return -1;
 
     *out=arr; *count=n; return 0;
 }
 
-void free_qtokens(QTok *arr, int n){ for(int i=0;i<n;i++) free(arr[i].val); free(arr); }
+// Appends w to the growing argv, doubling it (in the arena) when full
+static void push_arg(Arena *a, char ***argv, int *cap, int *n, char *w){
+    if(*n==*cap){
+        *cap = *cap ? *cap*2 : 16;
+        char **tmp = arena_alloc(a, *cap*sizeof(char*));
+        if(*n) memcpy(tmp, *argv, *n*sizeof(char*));
+        *argv=tmp;
+    }
+    (*argv)[(*n)++]=w;
+}
 
-void apply_globbing(char **argv, bool *was_quoted, int *argc){
-    char *outv[MAX_ARGS];
-    int m=0;
+char **apply_globbing(Arena *a, char **words, const bool *was_quoted, int *argc, int *exp_start, int *exp_end){
+    char **outv=NULL;
+    int m=0, cap=0;
+    *exp_start = *exp_end = 0;
 
     for(int i=0;i<*argc;i++){
-        char *w = argv[i];
-        bool q = was_quoted[i];
+        char *w = words[i];
 
-        if(q || strpbrk(w, "*?[]") == NULL){
-            if(m<MAX_ARGS-1) outv[m++]=w;
+        if(was_quoted[i] || strpbrk(w, "*?[]") == NULL){
+            push_arg(a, &outv, &cap, &m, w);
             continue;
         }
 
-        glob_t gr;
-        if(glob(w, 0, NULL, &gr) == 0){
-            for(size_t j=0;j<gr.gl_pathc && m<MAX_ARGS-1;j++){
-                outv[m++]=xstrdup(gr.gl_pathv[j]);
-            }
-            free(w);
+        char **matches;
+        int nm = glob_expand(a, w, &matches);
+        if(nm > 0){
+            if(*exp_end == 0) *exp_start = m;
+            for(int j=0;j<nm;j++) push_arg(a, &outv, &cap, &m, matches[j]);
+            *exp_end = m;
         }else{
-            if(m<MAX_ARGS-1) outv[m++]=w;
+            push_arg(a, &outv, &cap, &m, w);
         }
-        globfree(&gr);
     }
 
-    for(int i=0;i<m;i++) argv[i]=outv[i];
-    *argc=m; argv[m]=NULL;
+    push_arg(a, &outv, &cap, &m, NULL);
+    *argc=m-1;
+    return outv;
 }
@@ -0,0 +1,171 @@
+#define _GNU_SOURCE
+#include "trace.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+int trace_open(Trace *t, const char *path) {
+    // One run per file: t_ms restarts at 0 with every server, so runs appended
+    // to one trace would overlap
+    t->f = fopen(path, "w");
+    if (!t->f) {
+        perror(path);
+        return -1;
+    }
+    t->start_ms = now_ms();
+    pthread_mutex_init(&t->lock, NULL);
+    return 0;
+}
+
+void trace_close(Trace *t) {
+    if (!t->f) return;
+    fclose(t->f);
+    t->f = NULL;
+    pthread_mutex_destroy(&t->lock);
+}
+
+// Writes s as a JSON string literal
+static void put_json_string(FILE *f, const char *s) {
+    fputc('"', f);
+    for (const unsigned char *p = (const unsigned char *)s; *p; p++) {
+        switch (*p) {
+            case '"':  fputs("\\\"", f); break;
+            case '\\': fputs("\\\\", f); break;
+            case '\n': fputs("\\n", f); break;
+            case '\t': fputs("\\t", f); break;
+            case '\r': fputs("\\r", f); break;
+            default:
+                if (*p < 0x20) fprintf(f, "\\u%04x", *p);
+                else fputc(*p, f);
+        }
+    }
+    fputc('"', f);
+}
+
+void trace_record(Trace *t, int client_id, const char *command, int burst) {
+    if (!t->f) return;
+    pthread_mutex_lock(&t->lock);
+    fprintf(t->f, "{\"t_ms\": %.1f, \"client_id\": %d, \"command\": ", now_ms() - t->start_ms, client_id);
+    put_json_string(t->f, command);
+    fprintf(t->f, ", \"burst\": %d}\n", burst);
+    fflush(t->f);  // A trace cut short by a crash is still usable up to the last line
+    pthread_mutex_unlock(&t->lock);
+}
+
+// Value of "key": in the object on line, or NULL
+static const char *find_key(const char *line, const char *key) {
+    size_t klen = strlen(key);
+    for (const char *p = strchr(line, '"'); p; p = strchr(p + 1, '"')) {
+        if (p > line && p[-1] == '\\') continue;  // Inside a string, e.g. the command
+        if (strncmp(p + 1, key, klen) == 0 && p[klen + 1] == '"') {
+            p += klen + 2;
+            while (*p == ' ' || *p == ':') p++;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+// Decodes the JSON string literal at p into a malloc'd string, or NULL
+static char *get_json_string(const char *p) {
+    if (*p != '"') return NULL;
+    char *out = malloc(strlen(p) + 1), *o = out;
+    if (!out) {
+        perror("malloc");
+        _exit(127);
+    }
+    for (p++; *p && *p != '"'; p++) {
+        if (*p != '\\') {
+            *o++ = *p;
+            continue;
+        }
+        switch (*++p) {
+            case 'n': *o++ = '\n'; break;
+            case 't': *o++ = '\t'; break;
+            case 'r': *o++ = '\r'; break;
+            case 'u': {
+                // Only what trace_record() writes: control characters
+                unsigned v = 0;
+                if (sscanf(p + 1, "%4x", &v) != 1) {
+                    free(out);
+                    return NULL;
+                }
+                *o++ = (char)v;
+                p += 4;
+                break;
+            }
+            case '\0':
+                free(out);
+                return NULL;
+            default: *o++ = *p;  // \" \\ \/
+        }
+    }
+    if (*p != '"') {
+        free(out);
+        return NULL;
+    }
+    *o = '\0';
+    return out;
+}
+
+static int cmp_event(const void *a, const void *b) {
+    const TraceEvent *x = a, *y = b;
+    return x->t_ms < y->t_ms ? -1 : x->t_ms > y->t_ms;
+}
+
+int trace_load(const char *path, TraceEvent **out) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    TraceEvent *ev = NULL;
+    int n = 0, cap = 0, lineno = 0;
+    char *line = NULL;
+    size_t size = 0;
+    while (getline(&line, &size, f) >= 0) {
+        lineno++;
+        if (strspn(line, " \t\r\n") == strlen(line)) continue;
+        const char *t = find_key(line, "t_ms"), *c = find_key(line, "client_id");
+        const char *cmd = find_key(line, "command"), *b = find_key(line, "burst");
+        char *command = cmd ? get_json_string(cmd) : NULL;
+        if (!t || !c || !b || !command) {
+            fprintf(stderr, "%s:%d: expected t_ms, client_id, command and burst\n", path, lineno);
+            free(command);
+            trace_free(ev, n);
+            free(line);
+            fclose(f);
+            return -1;
+        }
+        if (n == cap) {
+            cap = cap ? cap * 2 : 64;
+            ev = realloc(ev, cap * sizeof(TraceEvent));
+            if (!ev) {
+                perror("realloc");
+                _exit(127);
+            }
+        }
+        ev[n++] = (TraceEvent){ strtod(t, NULL), atoi(c), command, atoi(b) };
+    }
+    free(line);
+    fclose(f);
+    // The server appends in arrival order; only a hand-edited trace needs sorting
+    // (qsort is not stable, so leave ordered ones alone)
+    int sorted = 1;
+    for (int i = 1; i < n && sorted; i++) sorted = ev[i - 1].t_ms <= ev[i].t_ms;
+    if (!sorted) qsort(ev, n, sizeof(TraceEvent), cmp_event);
+    *out = ev;
+    return n;
+}
+
+void trace_free(TraceEvent *events, int n) {
+    for (int i = 0; i < n; i++) free(events[i].command);
+    free(events);
+}
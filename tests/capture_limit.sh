@@ -0,0 +1,36 @@
+#!/bin/sh
+# Regression: a command list whose first pipeline hits the server's output cap
+# (-m) used to append to the full capture again in later list items (a syntax
+# error message, a session builtin), underflowing the room left and corrupting
+# the heap. The server must survive, mark the truncation once, and keep serving.
+# Run from the repository root after `make` (uses port 8080).
+
+fail() {
+    echo "FAIL: $*"
+    kill "$server" 2>/dev/null
+    exit 1
+}
+
+./server -m 10 -S > /tmp/capture_limit.$$.log 2>&1 &
+server=$!
+sleep 0.5
+
+# client -c exits with the list's status; only the output matters here
+expect_truncated() {
+    out=$(./client -c "$1" 2>&1)
+    kill -0 "$server" 2>/dev/null || fail "server died on: $1"
+    n=$(printf '%s\n' "$out" | grep -c 'output truncated')
+    [ "$n" -ge 1 ] || fail "no truncation marker for: $1"
+}
+
+expect_truncated 'ls /nope; ls |'            # Truncated stderr, then a syntax error
+expect_truncated 'seq 1 100; ls |'           # Truncated stdout, then a syntax error
+expect_truncated 'seq 1 100; cd /tmp; pwd'   # Truncated stdout, then a session builtin
+expect_truncated 'seq 1 100 && seq 1 100'    # Both pipelines past the cap
+
+out=$(./client -c 'echo hi' 2>/dev/null)
+printf '%s\n' "$out" | grep -qx hi || fail "server stopped answering"
+
+kill "$server"
+rm -f /tmp/capture_limit.$$.log
+echo "PASS: capture_limit"
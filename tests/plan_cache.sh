@@ -0,0 +1,28 @@
+#!/bin/sh
+# Regression: plans served from the server's plan cache (-L) must run exactly
+# like freshly parsed ones. A copied stage once kept an uninitialized group
+# pointer, so the second run of a cached pipeline crashed its child (exit=139).
+# Run from the repository root after `make` (uses port 8080).
+
+fail() {
+    echo "FAIL: $*"
+    kill "$server" 2>/dev/null
+    exit 1
+}
+
+./server -S -L 16 > /tmp/plan_cache.$$.log 2>&1 &
+server=$!
+sleep 0.5
+
+# Cold, then warm: the same text must give the same output and status
+for cmd in 'printf "a\nb\nc\n" | head -2' 'echo cached' 'ls / | grep -c .'; do
+    first=$(./client -c "$cmd" 2>&1; echo "status=$?")
+    for run in 2 3; do
+        again=$(./client -c "$cmd" 2>&1; echo "status=$?")
+        [ "$again" = "$first" ] || fail "run $run of '$cmd' differs: $again"
+    done
+done
+
+kill "$server"
+rm -f /tmp/plan_cache.$$.log
+echo "PASS: plan_cache"